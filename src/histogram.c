@@ -3,339 +3,1088 @@
 #include <string.h>
 #include <inttypes.h>
 #include <stdbool.h>
-#include <CL/cl.h>
+#include <math.h>
 #include <time.h>
-#include "FreeImage.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include "histogram_internal.h"
 
-#define BINS 256
-#define MAX_SOURCE_SIZE 16384
+typedef struct
+{
+	double t_cpu, t_gpu, speedup;
+	uint32_t coarsening;
+}
+perf_t;
 
-typedef struct 
+// NULL, če slike ni mogoče naložiti; meritev takrat vrne NAN
+uint8_t *load_image(gpu_t *gpu, const char *filename, uint32_t *width, uint32_t *height)
 {
-	uint32_t R[256];
-	uint32_t G[256];
-	uint32_t B[256];
+	uint8_t *image = NULL;
+	size_t capacity = 0;
+
+	if (!decode_image(gpu, filename, &image, &capacity, width, height)) {
+		fprintf(stderr, "cannot load %s\n", filename);
+		return NULL;
+	}
+
+	return image;
 }
-histogram_t;
 
-const uint32_t zero = 0U;
+perf_t cas_slike(gpu_t *gpu, uint8_t *image, const uint32_t width, const uint32_t height,
+                 const uint32_t wgsize, const uint32_t samples_cpu, const uint32_t samples_gpu)
+{
+    struct timespec start, finish;
+    perf_t perf;
 
-typedef struct
+    // Compute and print the histogram
+	histogram_t A, B;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples_cpu; i++) {
+		histogramCPU(&A, image, width, height, 0);
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	perf.t_cpu = (finish.tv_sec - start.tv_sec);
+    perf.t_cpu += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	perf.t_cpu /= samples_cpu;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples_gpu; i++) {
+    	histogramGPU(gpu, &B, image, width, height, wgsize);
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+    perf.t_gpu = (finish.tv_sec - start.tv_sec);
+    perf.t_gpu += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	perf.t_gpu /= samples_gpu;
+
+	perf.speedup = perf.t_cpu / perf.t_gpu;
+	perf.coarsening = gpu->coarsening;
+
+	if (gpu->profiling) {
+		char label[96];
+		const config_t cfg = launch_config(gpu, width, height, wgsize);
+		snprintf(label, sizeof(label), "%ux%u/%s/%ux%u", width, height, kernel_names[cfg.variant], cfg.rows, cfg.cols);
+		profile_report(&gpu->profile, label, gpu->profile_csv);
+	}
+
+    return equal(&A, &B) ? perf : (perf_t) { 0, 0, 0 };
+}
+
+perf_t cas_izvajanja(gpu_t *gpu, const char *filename, const uint32_t wgsize, const uint32_t samples_cpu, const uint32_t samples_gpu)
 {
-	double t_cpu, t_gpu, speedup;
+	uint32_t width, height;
+	uint8_t *image = load_image(gpu, filename, &width, &height);
+	if (!image)
+		return (perf_t) { NAN, NAN, NAN };
+
+	perf_t perf = cas_slike(gpu, image, width, height, wgsize, samples_cpu, samples_gpu);
+
+	free(image);
+
+	return perf;
 }
-perf_t;
 
+// povprečni čas večnitnega histograma; NAN, če se ne ujema z zaporednim
+double cas_niti(const char *filename, const uint32_t threads, const uint32_t samples)
+{
+    struct timespec start, finish;
+
+	uint32_t width, height;
+	uint8_t *image = load_image(NULL, filename, &width, &height);
+	if (!image)
+		return NAN;
+
+	histogram_t A, B;
+	histogramCPU(&A, image, width, height, 0);
 
-cl_context context;
-cl_program program;
-cl_command_queue command_queue;
-cl_kernel kernel;
-cl_mem hist_mem_obj;
-
-const char *errors[] = {
-    "CL_SUCCESS"                                      ,
-    "CL_DEVICE_NOT_FOUND"                             ,
-    "CL_DEVICE_NOT_AVAILABLE"                         ,
-    "CL_COMPILER_NOT_AVAILABLE"                       ,
-    "CL_MEM_OBJECT_ALLOCATION_FAILURE"                ,
-    "CL_OUT_OF_RESOURCES"                             ,
-    "CL_OUT_OF_HOST_MEMORY"                           ,
-    "CL_PROFILING_INFO_NOT_AVAILABLE"                 ,
-    "CL_MEM_COPY_OVERLAP"                             ,
-    "CL_IMAGE_FORMAT_MISMATCH"                        ,
-    "CL_IMAGE_FORMAT_NOT_SUPPORTED"                   ,
-    "CL_BUILD_PROGRAM_FAILURE"                        ,
-    "CL_MAP_FAILURE"                                  ,
-    "CL_MISALIGNED_SUB_BUFFER_OFFSET"                 ,
-    "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST"    ,
-    "CL_COMPILE_PROGRAM_FAILURE"                      ,
-    "CL_LINKER_NOT_AVAILABLE"                         ,
-    "CL_LINK_PROGRAM_FAILURE"                         ,
-    "CL_DEVICE_PARTITION_FAILED"                      ,
-    "CL_KERNEL_ARG_INFO_NOT_AVAILABLE"                ,
-    "CL_INVALID_VALUE"                                ,
-    "CL_INVALID_DEVICE_TYPE"                          ,
-    "CL_INVALID_PLATFORM"                             ,
-    "CL_INVALID_DEVICE"                               ,
-    "CL_INVALID_CONTEXT"                              ,
-    "CL_INVALID_QUEUE_PROPERTIES"                     ,
-    "CL_INVALID_COMMAND_QUEUE"                        ,
-    "CL_INVALID_HOST_PTR"                             ,
-    "CL_INVALID_MEM_OBJECT"                           ,
-    "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR"              ,
-    "CL_INVALID_IMAGE_SIZE"                           ,
-    "CL_INVALID_SAMPLER"                              ,
-    "CL_INVALID_BINARY"                               ,
-    "CL_INVALID_BUILD_OPTIONS"                        ,
-    "CL_INVALID_PROGRAM"                              ,
-    "CL_INVALID_PROGRAM_EXECUTABLE"                   ,
-    "CL_INVALID_KERNEL_NAME"                          ,
-    "CL_INVALID_KERNEL_DEFINITION"                    ,
-    "CL_INVALID_KERNEL"                               ,
-    "CL_INVALID_ARG_INDEX"                            ,
-    "CL_INVALID_ARG_VALUE"                            ,
-    "CL_INVALID_ARG_SIZE"                             ,
-    "CL_INVALID_KERNEL_ARGS"                          ,
-    "CL_INVALID_WORK_DIMENSION"                       ,
-    "CL_INVALID_WORK_GROUP_SIZE"                      ,
-    "CL_INVALID_WORK_ITEM_SIZE"                       ,
-    "CL_INVALID_GLOBAL_OFFSET"                        ,
-    "CL_INVALID_EVENT_WAIT_LIST"                      ,
-    "CL_INVALID_EVENT"                                ,
-    "CL_INVALID_OPERATION"                            ,
-    "CL_INVALID_GL_OBJECT"                            ,
-    "CL_INVALID_BUFFER_SIZE"                          ,
-    "CL_INVALID_MIP_LEVEL"                            ,
-    "CL_INVALID_GLOBAL_WORK_SIZE"                     ,
-    "CL_INVALID_PROPERTY"                             ,
-    "CL_INVALID_IMAGE_DESCRIPTOR"                     ,
-    "CL_INVALID_COMPILER_OPTIONS"                     ,
-    "CL_INVALID_LINKER_OPTIONS"                       ,
-    "CL_INVALID_DEVICE_PARTITION_COUNT"               ,
-};
-
-const char *cl_error(int status)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples; i++) {
+		histogramCPU_MT(&B, image, width, height, threads);
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	free(image);
+
+	return equal(&A, &B) ? t : NAN;
+}
+
+// povprečni čas jedra SIMD na ravni level; NAN, če se ne ujema z zaporednim
+double cas_simd(const char *filename, const int level, const uint32_t samples)
 {
-    return errors[-status];
+    struct timespec start, finish;
+
+	uint32_t width, height;
+	uint8_t *image = load_image(NULL, filename, &width, &height);
+	if (!image)
+		return NAN;
+
+	histogram_t A, B;
+	histogramCPU(&A, image, width, height, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples; i++) {
+		memset(&B, 0, sizeof(histogram_t));
+		simd_fns[level](&B, image, (size_t) width * height, 1, (size_t) width * height * 4);
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	free(image);
+
+	return equal(&A, &B) ? t : NAN;
+}
+
+// bin/histogram --batch <imenik | slike ...>: pretok slik na sekundo
+int batch_main(gpu_t *gpus, int ndev, int argc, const char **argv)
+{
+    struct timespec start, finish;
+
+	int n;
+	const char **files = collect_images(argc, argv, &n);
+	histogram_t *results = malloc(n * sizeof(histogram_t));
+	bool *ok = malloc(n * sizeof(bool));
+
+	// HIST_SCALE=2|4|8: približni histogrami iz pomanjšano dekodiranih JPEG-ov
+	const char *scale = getenv("HIST_SCALE");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	histogram_batch_multi(gpus, ndev, files, n, results, ok, 0, 0, scale && atoi(scale) > 1 ? atoi(scale) : 1);
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+	int failed = 0;
+	for (int i = 0; i < n; i++) {
+		if (!ok[i]) {
+			fprintf(stderr, "cannot load %s\n", files[i]);
+			failed++;
+		}
+	}
+	printf("naprav: %d, slik: %d (napak: %d), cas: %lf s, slik/s: %.1lf\n", ndev, n, failed, t, n / t);
+
+	for (int i = 0; i < n; i++)
+		free((char *) files[i]);
+	free(files);
+	free(results);
+	free(ok);
+
+	return failed ? 1 : 0;
 }
 
-uint32_t max(const uint32_t a, const uint32_t b) { return a >= b ? a : b; }
+// povprečni čas histograma na vseh napravah; NAN, če naprava odpove ali se ne ujema z zaporednim
+double cas_naprav(gpu_t *gpus, int ndev, const char *filename, const uint32_t wgsize, const uint32_t samples)
+{
+    struct timespec start, finish;
+
+	uint32_t width, height;
+	uint8_t *image = load_image(NULL, filename, &width, &height);
+	if (!image)
+		return NAN;
+
+	histogram_t A, B;
+	histogramCPU(&A, image, width, height, 0);
+
+	bool ok = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples && ok; i++) {
+		ok = histogramGPU_multi(gpus, ndev, &B, image, width, height, wgsize) == CL_SUCCESS;
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	free(image);
+
+	return ok && equal(&A, &B) ? t : NAN;
+}
 
-void cl_init()
+// povprečni čas hibridnega histograma; NAN, če GPE odpove ali se ne ujema z zaporednim
+double cas_hibrid(gpu_t *gpu, const char *filename, const uint32_t wgsize, const uint32_t samples)
 {
-	cl_int status;
-
-    // branje datoteke
-    FILE *fp = fopen("src/histogram.cl", "r");
-    if(!fp)
-    {
-        fprintf(stderr, "cannot open kernel file\n");
-        exit(2);
-    }
+    struct timespec start, finish;
+
+	uint32_t width, height;
+	uint8_t *image = load_image(gpu, filename, &width, &height);
+	if (!image)
+		return NAN;
+
+	histogram_t A, B;
+	histogramCPU(&A, image, width, height, 0);
 
-	// preberi kernel file
-    char *source_str = malloc(MAX_SOURCE_SIZE);
-    size_t source_size = fread(source_str, 1, MAX_SOURCE_SIZE, fp);
-    source_str[source_size] = '\0';
-    fclose(fp);
+	// prva slika umeri razmerje, šteje se ustaljeno stanje
+	bool ok = histogram_hybrid(gpu, &B, image, width, height, wgsize) == CL_SUCCESS;
 
-	// Podatki o platformi
-	cl_platform_id	platform_id[10];
-	cl_uint			ret_num_platforms;
-	status = clGetPlatformIDs(10, platform_id, &ret_num_platforms);
-	printf("ids: %s\n", cl_error(status));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples && ok; i++) {
+		ok = histogram_hybrid(gpu, &B, image, width, height, wgsize) == CL_SUCCESS;
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
 
-	// Podatki o napravi
-	cl_device_id	device_id[10];
-	cl_uint			ret_num_devices;
-	status = clGetDeviceIDs(platform_id[0], CL_DEVICE_TYPE_GPU, 10, device_id, &ret_num_devices);
-	printf("devices: %s\n", cl_error(status));
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	free(image);
 
-	// Kontekst
-	context = clCreateContext(NULL, 1, &device_id[0], NULL, NULL, NULL);
+	return ok && equal(&A, &B) ? t : NAN;
+}
 
-	// Ukazna vrsta
-	command_queue = clCreateCommandQueue(context, device_id[0], 0, NULL);
+// povprečni čas histograma po pasovih velikosti strip_mb MB; NAN, če se ne ujema z zaporednim
+double cas_pasov(gpu_t *gpu, const char *filename, const uint32_t strip_mb, const uint32_t samples)
+{
+    struct timespec start, finish;
 
-	// Priprava programa
-	program = clCreateProgramWithSource(context, 1, (const char **) &source_str, NULL, NULL);
+	uint32_t width, height;
+	uint8_t *image = load_image(gpu, filename, &width, &height);
+	if (!image)
+		return NAN;
 
-	// Prevajanje
-	status = clBuildProgram(program, 1, device_id, NULL, NULL, NULL);
-	printf("build: %s\n", cl_error(status));
+	histogram_t A, B;
+	histogramCPU(&A, image, width, height, 0);
 
-	if (status != 0) {
-		// Log
-		size_t build_log_len;
-		char *build_log;
-		status = clGetProgramBuildInfo(program, device_id[0], CL_PROGRAM_BUILD_LOG, 0, NULL, &build_log_len);
+	const size_t strip_bytes = gpu->strip_bytes;
+	gpu->strip_bytes = (size_t) strip_mb << 20;
 
-		build_log = (char *) malloc(build_log_len + 1);
-		clGetProgramBuildInfo(program, device_id[0], CL_PROGRAM_BUILD_LOG, build_log_len, build_log, NULL);
-		printf("%s\n", build_log);
-		free(build_log);
-		if(build_log_len > 2)	
-			exit(3);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples; i++) {
+		histogram_tiled(gpu, &B, image, width, height, 0);
 	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	gpu->strip_bytes = strip_bytes;
 
-	// kernel: priprava objekta
-	kernel = clCreateKernel(program, "calc_histogram", NULL);
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
 
-	hist_mem_obj = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(histogram_t), NULL, &status);
-	printf("make buffer: %s\n", cl_error(status));
+	free(image);
 
-	free(source_str);
+	return equal(&A, &B) ? t : NAN;
 }
 
-void cl_finalize()
+// povprečni čas histogramGPU na napravi, prevedeni za gpu->bins košev; NAN, če se
+// ne ujema z zaporednim histogramom, stisnjenim na toliko košev
+double cas_kosov(gpu_t *gpu, const char *filename, const uint32_t samples)
 {
-	clReleaseMemObject(hist_mem_obj);
-	clReleaseKernel(kernel);
-	clReleaseProgram(program);
-	clReleaseCommandQueue(command_queue);
-	clReleaseContext(context);
+    struct timespec start, finish;
+
+	uint32_t width, height;
+	uint8_t *image = load_image(gpu, filename, &width, &height);
+	if (!image)
+		return NAN;
+
+	histogram_t A, B;
+	histogramCPU(&A, image, width, height, 0);
+	fold_bins(&A, 1, gpu->bins);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples; i++) {
+		histogramGPU(gpu, &B, image, width, height, 0);
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	free(image);
+
+	return equal(&A, &B) ? t : NAN;
 }
 
-void histogramCPU(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+// povprečni čas dekodiranja in histograma na GPE v zapisu BGRA ali stisnjenem BGR
+// (packed); v *bytes zapiše bajte, prenesene na napravo na sliko. NAN, če se
+// histogram ne ujema z zaporednim.
+double cas_zapisa(gpu_t *gpu, const char *filename, const bool packed, const uint32_t samples, size_t *bytes)
 {
-	memset(H, 0, sizeof(histogram_t));
-    // Each color channel is 1 byte long, there are 4 channels BLUE, GREEN, RED and ALPHA
-    // The order is BLUE|GREEN|RED|ALPHA for each pixel, we ignore the ALPHA channel when computing the histograms
-	for (int i = 0; i < height; i++) {
-		for (int j = 0; j < width; j++)
-		{
-			H->R[image[(i * width + j) * 4 + 2]]++;
-			H->G[image[(i * width + j) * 4 + 1]]++;
-			H->B[image[(i * width + j) * 4 + 0]]++;
+    struct timespec start, finish;
+
+	uint8_t *image = NULL;
+	size_t capacity = 0;
+	uint32_t width, height;
+	histogram_t A, B;
+	bool ok = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples && ok; i++) {
+		if (packed) {
+			ok = decode_image_rgb(gpu, filename, &image, &capacity, &width, &height);
+			ok = ok && histogramGPU_rgb(gpu, &B, image, width, height, 0) == CL_SUCCESS;
+		}
+		else {
+			ok = decode_image(gpu, filename, &image, &capacity, &width, &height);
+			ok = ok && histogramGPU(gpu, &B, image, width, height, 0) == CL_SUCCESS;
 		}
 	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	if (ok) {
+		if (packed)
+			histogramCPU_rgb(&A, image, width, height, 0);
+		else
+			histogramCPU(&A, image, width, height, 0);
+	}
+	*bytes = gpu->zero_copy || !ok ? 0 : (size_t) width * height * (packed ? 3 : 4);
+	free(image);
+
+	return ok && equal(&A, &B) ? t : NAN;
 }
 
-void histogramGPU(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+// zapiše sliko BGR kot binarni PPM (P6, piksli R, G, B)
+bool write_ppm(const char *path, const uint8_t *image, const uint32_t width, const uint32_t height)
 {
-	cl_int status;
-
-	// Delitev dela
-	size_t local_item_size[] = { wgsize, wgsize };
-	size_t num_groups[] = { (height - 1) / local_item_size[0] + 1 , (width - 1) / local_item_size[1] + 1 };
-	size_t global_item_size[] = { num_groups[0] * local_item_size[0], num_groups[1] * local_item_size[1] };
-	//printf("global_item_size (%u, %u)\n", global_item_size[0], global_item_size[1]);
-
-	// Alokacija pomnilnika na napravi
-	cl_mem img_mem_obj  = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, width * height * 4, image, &status);
-	//printf("make buffer: %s\n", cl_error(status));
-
-	// kernel: argumenti
-	status  = clSetKernelArg(kernel, 0, sizeof(cl_mem),  (void *) &img_mem_obj);
-	status |= clSetKernelArg(kernel, 1, sizeof(cl_mem),  (void *) &hist_mem_obj);
-	status |= clSetKernelArg(kernel, 2, sizeof(cl_uint), (void *) &height);
-	status |= clSetKernelArg(kernel, 3, sizeof(cl_uint), (void *) &width);
-	//printf("arg: %s\n", cl_error(status));
-
-	status = clEnqueueFillBuffer(command_queue, hist_mem_obj, &zero, sizeof(uint32_t), 0, sizeof(histogram_t), 0, NULL, NULL);
-	// printf("fill: %s\n", cl_error(status)); fflush(stdout);
-
-	// kernel: zagon
-	status = clEnqueueNDRangeKernel(command_queue, kernel, 2, NULL, global_item_size, local_item_size, 0, NULL, NULL);
-	// printf("enqueue: %s\n", cl_error(status));
-
-	// Kopiranje rezultatov
-	status = clEnqueueReadBuffer(command_queue, hist_mem_obj, CL_TRUE, 0, sizeof(histogram_t), H, 0, NULL, NULL);
-	//printf("read: %s\n", cl_error(status));
-
-	// čiščenje
-	clFlush(command_queue);
-	clFinish(command_queue);
-	clReleaseMemObject(img_mem_obj);
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return false;
+
+	fprintf(f, "P6\n%u %u\n255\n", width, height);
+	uint8_t *row = malloc((size_t) width * 3);
+	for (uint32_t i = 0; i < height; i++) {
+		for (uint32_t j = 0; j < width; j++) {
+			const uint8_t *p = image + ((size_t) i * width + j) * 3;
+			row[3 * j + 0] = p[2];
+			row[3 * j + 1] = p[1];
+			row[3 * j + 2] = p[0];
+		}
+		fwrite(row, 3, width, f);
+	}
+	free(row);
+
+	return fclose(f) == 0;
 }
 
-void printHistogram(histogram_t *H) {
-	printf("Colour\tNo. Pixels\n");
-	for (int i = 0; i < BINS; i++) {
-		if (H->B[i] > 0)
-			printf("%dB\t%d\n", i, H->B[i]);
-		if (H->G[i] > 0)
-			printf("%dG\t%d\n", i, H->G[i]);
-		if (H->R[i] > 0)
-			printf("%dR\t%d\n", i, H->R[i]);
+// povprečni čas branja datoteke in histograma prek FreeImage ali preslikave v
+// pomnilnik (mapped); gpu == NULL: vse niti CPE. NAN, če se ne ujema z zaporednim.
+double cas_branja(gpu_t *gpu, const char *filename, const bool mapped, const uint32_t samples)
+{
+    struct timespec start, finish;
+
+	uint8_t *image = NULL;
+	size_t capacity = 0;
+	uint32_t width, height;
+	histogram_t A, B;
+	bool ok = decode_image(NULL, filename, &image, &capacity, &width, &height);
+	if (ok)
+		histogramCPU(&A, image, width, height, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples && ok; i++) {
+		if (mapped) {
+			mapped_t img;
+			ok = map_image(filename, &img) == MAPPED_OK;
+			ok = ok && histogram_mapped(gpu, &B, &img, 0) == CL_SUCCESS;
+			unmap_image(&img);
+		}
+		else {
+			ok = decode_image(gpu, filename, &image, &capacity, &width, &height);
+			if (ok && gpu)
+				ok = histogramGPU(gpu, &B, image, width, height, 0) == CL_SUCCESS;
+			else if (ok)
+				histogramCPU_MT(&B, image, width, height, 0);
+		}
 	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	free(image);
+
+	return ok && equal(&A, &B) ? t : NAN;
 }
 
-bool equal(histogram_t *A, histogram_t *B)
+// povprečni čas histograma osrednjega izreza (polovica širine in višine) na GPE
+// ali, pri gpu == NULL, na vseh jedrih CPE; izrez se prepiše v strnjen medpomnilnik
+// ali šteje na mestu z razmikom vrstic. NAN, če se ne ujema z zaporednim.
+double cas_izreza(gpu_t *gpu, const char *filename, const bool inplace, const uint32_t samples)
 {
-	for (int i = 0; i < BINS; i++) {
-		if (A->R[i] != B->R[i]) return false;
-		if (A->G[i] != B->G[i]) return false;
-		if (A->B[i] != B->B[i]) return false;
+    struct timespec start, finish;
+
+	uint32_t width, height;
+	uint8_t *image = load_image(NULL, filename, &width, &height);
+	if (!image)
+		return NAN;
+
+	const uint32_t roi_width = width / 2, roi_height = height / 2;
+	const size_t pitch = (size_t) width * 4, row_bytes = (size_t) roi_width * 4;
+	const uint8_t *roi = image + (size_t) (height / 4) * pitch + (size_t) (width / 4) * 4;
+	uint8_t *copy = image_alloc(gpu, (size_t) roi_height * row_bytes);
+
+	histogram_t A, B;
+	for (uint32_t y = 0; y < roi_height; y++)
+		memcpy(copy + y * row_bytes, roi + y * pitch, row_bytes);
+	histogramCPU(&A, copy, roi_width, roi_height, 0);
+	bool ok = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples && ok; i++) {
+		if (inplace && gpu)
+			ok = histogramGPU_pitch(gpu, &B, roi, roi_width, roi_height, pitch, 4, 0) == CL_SUCCESS;
+		else if (inplace)
+			histogramCPU_pitch(&B, roi, roi_width, roi_height, pitch, 4, 0, false);
+		else {
+			for (uint32_t y = 0; y < roi_height; y++)
+				memcpy(copy + y * row_bytes, roi + y * pitch, row_bytes);
+			if (gpu)
+				ok = histogramGPU(gpu, &B, copy, roi_width, roi_height, 0) == CL_SUCCESS;
+			else
+				histogramCPU_MT(&B, copy, roi_width, roi_height, 0);
+		}
 	}
-	return true;
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	free(copy);
+	free(image);
+
+	return ok && equal(&A, &B) ? t : NAN;
 }
 
-perf_t cas_izvajanja(const char *filename, const uint32_t wgsize, const uint32_t samples_cpu, const uint32_t samples_gpu)
+// povprečni čas histogramov mreže tiles x tiles ploščic na GPE ali, pri gpu == NULL,
+// na vseh jedrih CPE: v enem prehodu ali s klicem na ploščico (single). NAN, če se
+// vsota ploščic ne ujema z zaporednim histogramom cele slike.
+double cas_ploscic(gpu_t *gpu, const char *filename, const uint32_t tiles, const bool single, const uint32_t samples)
 {
     struct timespec start, finish;
-    perf_t perf;
 
-    // Load image from file
-	FIBITMAP *imageJpeg = FreeImage_Load(FIF_JPEG, filename, 0);
-	// Convert it to a 32-bit image
-    FIBITMAP *imageJpeg32 = FreeImage_ConvertTo32Bits(imageJpeg);
+	uint32_t width, height;
+	uint8_t *image = load_image(NULL, filename, &width, &height);
+	if (!image)
+		return NAN;
+	const size_t pitch = (size_t) width * 4;
 
-    // Get image dimensions
-    uint32_t width  = FreeImage_GetWidth(imageJpeg32);
-	uint32_t height = FreeImage_GetHeight(imageJpeg32);
-	uint32_t pitch  = FreeImage_GetPitch(imageJpeg32);
-	// Preapare room for a raw data copy of the image
-    uint8_t *image = (uint8_t *) malloc(height * pitch * sizeof(uint8_t));
+	// ista delitev kot pri hist_compute_grid
+	const uint32_t n = tiles * tiles;
+	hist_rect_t *rects = malloc(n * sizeof(hist_rect_t));
+	grid_rects(rects, width, height, tiles, tiles);
 
-    // Extract raw data from the image
-	FreeImage_ConvertToRawBits(image, imageJpeg, pitch, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, TRUE);
+	histogram_t A, S, *B = malloc(n * sizeof(histogram_t));
+	histogramCPU(&A, image, width, height, 0);
+	bool ok = true;
 
-    // Free source image data
-	FreeImage_Unload(imageJpeg32);
-	FreeImage_Unload(imageJpeg);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples && ok; i++) {
+		if (!single && gpu)
+			ok = histogramGPU_rects(gpu, B, image, width, height, 0, 4, rects, n, 0) == CL_SUCCESS;
+		else if (!single)
+			histogramCPU_rects(B, image, pitch, 4, rects, n, 0, false);
+		for (uint32_t r = 0; single && r < n && ok; r++) {
+			const uint8_t *tile = image + rects[r].y * pitch + (size_t) rects[r].x * 4;
+			if (gpu)
+				ok = histogramGPU_pitch(gpu, &B[r], tile, rects[r].width, rects[r].height, pitch, 4, 0) == CL_SUCCESS;
+			else
+				histogramCPU_pitch(&B[r], tile, rects[r].width, rects[r].height, pitch, 4, 0, false);
+		}
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
 
-    // Compute and print the histogram
-	histogram_t A, B;
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	memset(&S, 0, sizeof(histogram_t));
+	for (uint32_t r = 0; r < n; r++) {
+		for (int i = 0; i < BINS; i++) {
+			S.R[i] += B[r].R[i];
+			S.G[i] += B[r].G[i];
+			S.B[i] += B[r].B[i];
+		}
+	}
+	free(B);
+	free(rects);
+	free(image);
+
+	return ok && equal(&A, &S) ? t : NAN;
+}
+
+// povprečni čas izenačenja histograma na GPE ali, pri gpu == NULL, na vseh jedrih
+// CPE; NAN, če se izhod ne ujema z zaporednim izenačenjem
+double cas_izenacenja(gpu_t *gpu, const char *filename, const uint32_t samples)
+{
+    struct timespec start, finish;
+
+	uint32_t width, height;
+	uint8_t *image = load_image(NULL, filename, &width, &height);
+	if (!image)
+		return NAN;
+	const size_t size = (size_t) width * height * 4;
+	uint8_t *A = malloc(size), *B = image_alloc(gpu, size);
+	equalizeCPU(A, image, width, height, (size_t) width * 4, 4, 1, true);
+	bool ok = true;
 
     clock_gettime(CLOCK_MONOTONIC, &start);
-	for (int i = 0; i < samples_cpu; i++) {
-		histogramCPU(&A, image, width, height, 0);
+	for (int i = 0; i < samples && ok; i++) {
+		if (gpu)
+			ok = equalizeGPU(gpu, B, image, width, height, 0, 4, 0) == CL_SUCCESS;
+		else
+			equalizeCPU(B, image, width, height, (size_t) width * 4, 4, 0, false);
 	}
     clock_gettime(CLOCK_MONOTONIC, &finish);
 
-	perf.t_cpu = (finish.tv_sec - start.tv_sec);
-    perf.t_cpu += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
-	perf.t_cpu /= samples_cpu;
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
+
+	ok = ok && memcmp(A, B, size) == 0;
+	free(A);
+	free(B);
+	free(image);
+
+	return ok ? t : NAN;
+}
+
+// povprečni čas CLAHE z mrežo tiles x tiles in mejo clip na GPE ali, pri gpu == NULL,
+// na vseh jedrih CPE; NAN, če se izhod ne ujema z zaporednim CLAHE
+double cas_clahe(gpu_t *gpu, const char *filename, uint32_t tiles, float clip, const uint32_t samples)
+{
+    struct timespec start, finish;
+
+	uint32_t width, height;
+	uint8_t *image = load_image(NULL, filename, &width, &height);
+	if (!image)
+		return NAN;
+	const size_t size = (size_t) width * height * 4;
+	uint8_t *A = malloc(size), *B = image_alloc(gpu, size);
+	claheCPU(A, image, width, height, (size_t) width * 4, 4, tiles, tiles, clip, 1, true);
+	bool ok = true;
 
     clock_gettime(CLOCK_MONOTONIC, &start);
-	for (int i = 0; i < samples_gpu; i++) {
-    	histogramGPU(&B, image, width, height, wgsize);
+	for (int i = 0; i < samples && ok; i++) {
+		if (gpu)
+			ok = claheGPU(gpu, B, image, width, height, 0, 4, tiles, tiles, clip, 0) == CL_SUCCESS;
+		else
+			claheCPU(B, image, width, height, (size_t) width * 4, 4, tiles, tiles, clip, 0, false);
 	}
     clock_gettime(CLOCK_MONOTONIC, &finish);
 
-    perf.t_gpu = (finish.tv_sec - start.tv_sec);
-    perf.t_gpu += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
-	perf.t_gpu /= samples_gpu;
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
 
-	perf.speedup = perf.t_cpu / perf.t_gpu;
+	ok = ok && memcmp(A, B, size) == 0;
+	free(A);
+	free(B);
+	free(image);
+
+	return ok ? t : NAN;
+}
+
+// razlika porazdelitev: polovica vsote |p - q| po koših, povprečje kanalov
+// (0 = enaki, 1 = brez skupnih vrednosti)
+double razdalja(const histogram_t *A, const histogram_t *B)
+{
+	const uint32_t *a[] = { A->R, A->G, A->B }, *b[] = { B->R, B->G, B->B };
+	double d = 0;
+
+	for (int c = 0; c < 3; c++) {
+		double sum_a = 0, sum_b = 0, diff = 0;
+		for (int i = 0; i < BINS; i++) {
+			sum_a += a[c][i];
+			sum_b += b[c][i];
+		}
+		for (int i = 0; i < BINS && sum_a > 0 && sum_b > 0; i++)
+			diff += fabs(a[c][i] / sum_a - b[c][i] / sum_b);
+		d += diff / 2 / 3;
+	}
+
+	return d;
+}
+
+// povprečni čas dekodiranja v merilu 1/scale in histograma na GPE; v *error
+// zapiše razdaljo do natančnega histograma
+double cas_priblizno(gpu_t *gpu, const char *filename, const uint32_t scale, const uint32_t samples, double *error)
+{
+    struct timespec start, finish;
+
+	uint8_t *image = NULL;
+	size_t capacity = 0;
+	uint32_t width, height;
+	uint64_t full;
+	histogram_t A, B;
+	bool ok = decode_image(NULL, filename, &image, &capacity, &width, &height);
+	if (ok)
+		histogramCPU(&A, image, width, height, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < samples && ok; i++) {
+		ok = decode_image_scaled(gpu, filename, scale, &image, &capacity, &width, &height, &full);
+		ok = ok && histogramGPU(gpu, &B, image, width, height, 0) == CL_SUCCESS;
+		scale_counts(&B, full, (uint64_t) width * height);
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	double t = (finish.tv_sec - start.tv_sec);
+    t += (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	t /= samples;
 
 	free(image);
 
-    return equal(&A, &B) ? perf : (perf_t) { 0, 0, 0 };
+	*error = ok ? razdalja(&A, &B) : NAN;
+	return ok ? t : NAN;
+}
+
+// bin/histogram --tune <imenik | slike ...>: uglasi vse izbrane naprave za razrede velikosti danih slik
+int tune_main(gpu_t *gpus, int ndev, int argc, const char **argv)
+{
+	int n, failed = 0;
+	const char **files = collect_images(argc, argv, &n);
+
+    printf("%-24s %10s %22s %9s %12s\n", "naprava", "slika", "kernel", "skupina", "cas");
+	for (int d = 0; d < ndev; d++) {
+		char name[128];
+		clGetDeviceInfo(gpus[d].device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+
+		for (int i = 0; i < n; i++) {
+			uint32_t width, height;
+			uint8_t *image = NULL;
+			size_t capacity = 0;
+			if (!decode_image(&gpus[d], files[i], &image, &capacity, &width, &height)) {
+				fprintf(stderr, "cannot load %s\n", files[i]);
+				failed++;
+				continue;
+			}
+
+			const config_t best = autotune(&gpus[d], image, width, height);
+			char size[24], shape[24];
+			snprintf(size, sizeof(size), "%ux%u", width, height);
+			snprintf(shape, sizeof(shape), "%ux%u", best.rows, best.cols);
+			printf("%-24.24s %10s %22s %9s %12lf\n", name, size,
+				best.variant >= 0 ? kernel_names[best.variant] : "-", shape, best.seconds);
+			fflush(stdout);
+			free(image);
+		}
+		tuning_save(&gpus[d]);
+	}
+
+	for (int i = 0; i < n; i++)
+		free((char *) files[i]);
+	free(files);
+
+	return failed ? 1 : 0;
 }
 
+// bin/histogram [--device spec] [--list-devices | --tune <...> | --batch <imenik | slike ...>]
 int main(int argc, const char **argv)
 {
-	cl_init();
+	const char *device_spec = NULL;
+	if (argc > 2 && strcmp(argv[1], "--device") == 0) {
+		device_spec = argv[2];
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--list-devices") == 0) {
+		print_devices();
+		return 0;
+	}
 
-    printf("%7s %12s %12s %12s %12s %12s %12s %s\n",
-		"WG size", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "8000x8000", "pohitritev");
+	// izpis stanja inicializacije kot doslej
+	hist_verbose = true;
+
+	gpu_t gpus[MAX_DEVICES];
+	const int ndev = cl_init_devices(gpus, MAX_DEVICES, device_spec);
+	if (ndev < 0)
+		return ndev == CL_DEVICE_NOT_FOUND ? 5 : ndev == CL_BUILD_PROGRAM_FAILURE ? 3 : 2;
+	gpu_t *gpu = &gpus[0];
+
+	if (argc > 2 && (strcmp(argv[1], "--batch") == 0 || strcmp(argv[1], "--tune") == 0)) {
+		int ret = strcmp(argv[1], "--batch") == 0 ?
+			batch_main(gpus, ndev, argc - 2, argv + 2) : tune_main(gpus, ndev, argc - 2, argv + 2);
+		for (int d = 0; d < ndev; d++)
+			cl_finalize(&gpus[d]);
+		return ret;
+	}
+
+    printf("%7s %12s %12s %12s %12s %12s %s\n",
+		"WG size", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
 	fflush(stdout);
 
-    for (int wgsize = 4; wgsize <= 32; wgsize *= 2) {
+	// 32x32 lahko preseže CL_KERNEL_WORK_GROUP_SIZE
+    for (int wgsize = 4; wgsize <= 32 && (size_t) wgsize * wgsize <= gpu->max_wg[gpu->variant]; wgsize *= 2) {
 		printf("%7u ", wgsize); fflush(stdout);
-		perf_t perf_640_480gpu   = cas_izvajanja("test/640x480.jpg",   wgsize, 10, 10);
+		perf_t perf_640_480gpu   = cas_izvajanja(gpu, "test/640x480.jpg",   wgsize, 10, 10);
 		printf("%12lf ", perf_640_480gpu.t_gpu); fflush(stdout);
-		perf_t perf_800_600gpu   = cas_izvajanja("test/800x600.jpg",   wgsize, 10, 10);
+		perf_t perf_800_600gpu   = cas_izvajanja(gpu, "test/800x600.jpg",   wgsize, 10, 10);
 		printf("%12lf ", perf_800_600gpu.t_gpu); fflush(stdout);
-		perf_t perf_1600_900gpu  = cas_izvajanja("test/1600x900.jpg",  wgsize, 10, 10);
+		perf_t perf_1600_900gpu  = cas_izvajanja(gpu, "test/1600x900.jpg",  wgsize, 10, 10);
 		printf("%12lf ", perf_1600_900gpu.t_gpu); fflush(stdout);
-		perf_t perf_1920_1080gpu = cas_izvajanja("test/1920x1080.jpg", wgsize, 10, 10);
+		perf_t perf_1920_1080gpu = cas_izvajanja(gpu, "test/1920x1080.jpg", wgsize, 10, 10);
 		printf("%12lf ", perf_1920_1080gpu.t_gpu); fflush(stdout);
-		perf_t perf_3840_2160gpu = cas_izvajanja("test/3840x2160.jpg", wgsize, 10, 10);
+		perf_t perf_3840_2160gpu = cas_izvajanja(gpu, "test/3840x2160.jpg", wgsize, 10, 10);
 		printf("%12lf ", perf_3840_2160gpu.t_gpu); fflush(stdout);
-    	perf_t perf_8000_8000gpu = cas_izvajanja("test/8000x8000.jpg", wgsize, 10, 10);
-		printf("%12lf ", perf_8000_8000gpu.t_gpu); fflush(stdout);
 
-        printf("%.3lf,%.3lf,%.3lf,%.3lf,%.3lf,%.3lf\n",
+        printf("%.3lf,%.3lf,%.3lf,%.3lf,%.3lf\n",
 			perf_640_480gpu.speedup, perf_800_600gpu.speedup, perf_1600_900gpu.speedup, 
-			perf_1920_1080gpu.speedup, perf_3840_2160gpu.speedup, perf_8000_8000gpu.speedup
+			perf_1920_1080gpu.speedup, perf_3840_2160gpu.speedup
         );
     }
 
-	cl_finalize();
+	const char *images[] = {
+		"test/640x480.jpg", "test/800x600.jpg", "test/1600x900.jpg",
+		"test/1920x1080.jpg", "test/3840x2160.jpg"
+	};
+	const int n_images = sizeof(images) / sizeof(images[0]);
+
+	// ostale različice kernela; k = pikslov na nit, WG size je število niti v skupini
+	const int default_variant = gpu->variant;
+	for (int v = KERNEL_COARSE; v < KERNELS; v++) {
+		size_t max_wg;
+		clGetKernelWorkGroupInfo(gpu->kernels[v], gpu->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_wg, NULL);
+		gpu->variant = v;
+
+		printf("\n%s\n%7s %19s %19s %19s %19s %19s %s\n", kernel_names[v],
+			"WG size", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+		fflush(stdout);
+
+		for (int wgsize = 4; wgsize <= 32 && wgsize * wgsize <= max_wg; wgsize *= 2) {
+			perf_t perf[n_images];
+			printf("%7u ", wgsize * wgsize); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				perf[k] = cas_izvajanja(gpu, images[k], wgsize, 10, 10);
+				printf("%12lf k=%-5u ", perf[k].t_gpu, perf[k].coarsening); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", perf[k].speedup, k + 1 < n_images ? "," : "\n");
+		}
+	}
+	gpu->variant = default_variant;
+
+	// najslabši primer za lokalne atomarne operacije: enobarvna slika 3840x2160
+	{
+		const uint32_t width = 3840, height = 2160;
+		uint8_t *image = image_alloc(gpu, (size_t) width * height * 4);
+		for (size_t i = 0; i < (size_t) width * height; i++)
+			memcpy(image + 4 * i, (uint8_t[]) { 40, 120, 200, 255 }, 4);
+
+		printf("\nenobarvna 3840x2160, WG size 256\n%22s %12s %s\n", "kernel", "cas", "pohitritev");
+		for (int v = 0; v < KERNELS; v++) {
+			gpu->variant = v;
+			perf_t perf = cas_slike(gpu, image, width, height, 16, 10, 10);
+			printf("%22s %12lf %.3lf\n", kernel_names[v], perf.t_gpu, perf.speedup); fflush(stdout);
+		}
+		gpu->variant = default_variant;
+		free(image);
+	}
+
+	// uglaševanje: najboljša nastavitev za vsak razred velikosti, shranjena za naslednje zagone;
+	// pohitritev je glede na privzeto skupino 16x16
+	printf("\nuglaševanje\n%10s %22s %9s %12s %s\n", "slika", "kernel", "skupina", "cas", "pohitritev");
+	fflush(stdout);
+	for (int k = 0; k < n_images; k++) {
+		uint32_t width, height;
+		uint8_t *image = load_image(gpu, images[k], &width, &height);
+		if (!image)
+			continue;
+
+		const config_t best = autotune(gpu, image, width, height);
+		const perf_t perf = cas_slike(gpu, image, width, height, 0, 1, 10);
+		const perf_t base = cas_slike(gpu, image, width, height, 16, 1, 10);
+
+		char size[24], shape[24];
+		snprintf(size, sizeof(size), "%ux%u", width, height);
+		snprintf(shape, sizeof(shape), "%ux%u", best.rows, best.cols);
+		printf("%10s %22s %9s %12lf %.3lf\n", size, best.variant >= 0 ? kernel_names[best.variant] : "-",
+			shape, perf.t_gpu, base.t_gpu / perf.t_gpu);
+		fflush(stdout);
+		free(image);
+	}
+	tuning_save(gpu);
+
+	// skaliranje večnitnega histograma na CPE: 1, 2, 4, ... niti do števila jeder
+	const uint32_t max_threads = cpu_threads();
+	double t_one[n_images];
+
+    printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+		"niti", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+
+	for (uint32_t threads = 1; ; threads *= 2) {
+		if (threads > max_threads) threads = max_threads;
+		double t[n_images];
+		printf("%7u ", threads); fflush(stdout);
+		for (int k = 0; k < n_images; k++) {
+			t[k] = cas_niti(images[k], threads, 10);
+			if (threads == 1) t_one[k] = t[k];
+			printf("%12lf ", t[k]); fflush(stdout);
+		}
+		for (int k = 0; k < n_images; k++)
+			printf("%.3lf%s", t_one[k] / t[k], k + 1 < n_images ? "," : "\n");
+		if (threads == max_threads) break;
+	}
+
+	// CPE in GPE hkrati; stolpec CPE pove delež vrstic, ki ga je na koncu dobila CPE
+    printf("\n%7s %19s %19s %19s %19s %19s %s\n",
+		"hibrid", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		double t_gpu[n_images], t_hyb[n_images];
+		printf("%7s ", ""); fflush(stdout);
+		for (int k = 0; k < n_images; k++) {
+			t_gpu[k] = cas_izvajanja(gpu, images[k], 16, 1, 10).t_gpu;
+			t_hyb[k] = cas_hibrid(gpu, images[k], 16, 10);
+			printf("%12lf CPE=%2.0lf%% ", t_hyb[k], 100 * gpu->hybrid_share); fflush(stdout);
+		}
+		for (int k = 0; k < n_images; k++)
+			printf("%.3lf%s", t_gpu[k] / t_hyb[k], k + 1 < n_images ? "," : "\n");
+	}
+
+	// zapis slike: BGRA (4 bajti) ali stisnjeni BGR (3 bajti) s calc_histogram_rgb;
+	// čas vključuje dekodiranje, MB je prenos na napravo na sliko
+    printf("\n%7s %19s %19s %19s %19s %19s %s\n",
+		"zapis", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		double t_fmt[2][n_images];
+		for (int packed = 0; packed < 2; packed++) {
+			printf("%7s ", packed ? "BGR" : "BGRA"); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				size_t bytes;
+				t_fmt[packed][k] = cas_zapisa(gpu, images[k], packed, 10, &bytes);
+				printf("%12lf %5.1lfM ", t_fmt[packed][k], bytes / 1e6); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t_fmt[0][k] / t_fmt[packed][k], k + 1 < n_images ? "," : "\n");
+		}
+	}
+
+	// približni histogrami: JPEG dekodiran v merilu 1/scale; napaka je razdalja
+	// porazdelitev do natančnega histograma, pohitritev je glede na polno dekodiranje
+    printf("\n%7s %19s %19s %19s %19s %19s %s\n",
+		"merilo", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		double t_full[n_images];
+		for (uint32_t scale = 1; scale <= 8; scale *= 2) {
+			double t[n_images];
+			printf("%5s%-2u ", "1/", scale); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				double error;
+				t[k] = cas_priblizno(gpu, images[k], scale, 10, &error);
+				if (scale == 1) t_full[k] = t[k];
+				printf("%12lf %5.2lf%% ", t[k], 100 * error); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t_full[k] / t[k], k + 1 < n_images ? "," : "\n");
+		}
+	}
+
+	// nestisnjene slike (P6 v začasnem imeniku): FreeImage ali preslikava v pomnilnik;
+	// pohitritev preslikave je glede na FreeImage na isti napravi
+    printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+		"branje", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		char ppm[n_images][PATH_MAX];
+		const char *tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+		for (int k = 0; k < n_images; k++) {
+			uint8_t *image = NULL;
+			size_t capacity = 0;
+			uint32_t width, height;
+			snprintf(ppm[k], sizeof(ppm[k]), "%s/histogram-%d-%d.ppm", tmp, (int) getpid(), k);
+			if (!decode_image_rgb(NULL, images[k], &image, &capacity, &width, &height) ||
+			    !write_ppm(ppm[k], image, width, height))
+				fprintf(stderr, "cannot write %s\n", ppm[k]);
+			free(image);
+		}
+
+		const char *labels[] = { "FI CPE", "mm CPE", "FI GPE", "mm GPE" };
+		double t[4][n_images];
+		for (int r = 0; r < 4; r++) {
+			printf("%7s ", labels[r]); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				t[r][k] = cas_branja(r < 2 ? NULL : gpu, ppm[k], r % 2, 10);
+				printf("%12lf ", t[r][k]); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t[r - r % 2][k] / t[r][k], k + 1 < n_images ? "," : "\n");
+		}
+
+		for (int k = 0; k < n_images; k++)
+			remove(ppm[k]);
+	}
+
+	// osrednji izrez slike: prepis v strnjen medpomnilnik ali štetje na mestu z razmikom
+	// vrstic; pohitritev je glede na prepis na isti napravi
+    printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+		"izrez", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		const char *labels[] = { "kop CPE", "izr CPE", "kop GPE", "izr GPE" };
+		double t[4][n_images];
+		for (int r = 0; r < 4; r++) {
+			printf("%7s ", labels[r]); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				t[r][k] = cas_izreza(r < 2 ? NULL : gpu, images[k], r % 2, 10);
+				printf("%12lf ", t[r][k]); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t[r - r % 2][k] / t[r][k], k + 1 < n_images ? "," : "\n");
+		}
+	}
+
+	// mreža 8x8 ploščic: klic na ploščico ali vse v enem prehodu; pohitritev je
+	// glede na klice na ploščico na isti napravi
+    printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+		"8x8", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		const char *labels[] = { "64x CPE", "1x CPE", "64x GPE", "1x GPE" };
+		double t[4][n_images];
+		for (int r = 0; r < 4; r++) {
+			printf("%7s ", labels[r]); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				t[r][k] = cas_ploscic(r < 2 ? NULL : gpu, images[k], 8, r % 2 == 0, 10);
+				printf("%12lf ", t[r][k]); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t[r - r % 2][k] / t[r][k], k + 1 < n_images ? "," : "\n");
+		}
+	}
+
+	// izenačenje histograma (histogram, CDF, LUT, preslikava); na GPE ostanejo vmesni
+	// rezultati na napravi; pohitritev je glede na CPE
+    printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+		"izenac", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		double t[2][n_images];
+		for (int r = 0; r < 2; r++) {
+			printf("%7s ", r ? "GPE" : "CPE"); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				t[r][k] = cas_izenacenja(r ? gpu : NULL, images[k], 10);
+				printf("%12lf ", t[r][k]); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t[0][k] / t[r][k], k + 1 < n_images ? "," : "\n");
+		}
+	}
+
+	// CLAHE z mrežo 8x8 in mejo 2.0; pohitritev je glede na CPE
+    printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+		"CLAHE", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		double t[2][n_images];
+		for (int r = 0; r < 2; r++) {
+			printf("%7s ", r ? "GPE" : "CPE"); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				t[r][k] = cas_clahe(r ? gpu : NULL, images[k], 8, 2.0f, 10);
+				printf("%12lf ", t[r][k]); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t[0][k] / t[r][k], k + 1 < n_images ? "," : "\n");
+		}
+	}
+
+	// manj košev na kanal: kerneli, prevedeni z -DBINS, imajo manjše lokalne histograme
+	// in več kopij; pohitritev je glede na 256 košev
+    printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+		"kosi", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		double t_full[n_images];
+		for (uint32_t bins = BINS; bins >= 16; bins /= 2) {
+			gpu_t coarse;
+			if (bins != BINS && cl_init_devices_bins(&coarse, 1, device_spec, bins) < 0)
+				continue;
+			gpu_t *g = bins == BINS ? gpu : &coarse;
+
+			double t[n_images];
+			printf("%7u ", bins); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				t[k] = cas_kosov(g, images[k], 10);
+				if (bins == BINS)
+					t_full[k] = t[k];
+				printf("%12lf ", t[k]); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t_full[k] / t[k], k + 1 < n_images ? "," : "\n");
+
+			if (bins != BINS)
+				cl_finalize(&coarse);
+		}
+	}
+
+	// pretakanje po pasovih skozi obroč gpu->strips medpomnilnikov; pohitritev je
+	// glede na prenos cele slike naenkrat
+    printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+		"pas MB", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+	fflush(stdout);
+	{
+		double t_whole[n_images];
+		for (int k = 0; k < n_images; k++)
+			t_whole[k] = cas_izvajanja(gpu, images[k], 0, 1, 10).t_gpu;
+
+		for (uint32_t strip_mb = 1; strip_mb <= 64; strip_mb *= 4) {
+			double t[n_images];
+			printf("%7u ", strip_mb); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				t[k] = cas_pasov(gpu, images[k], strip_mb, 10);
+				printf("%12lf ", t[k]); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t_whole[k] / t[k], k + 1 < n_images ? "," : "\n");
+		}
+	}
+
+	// vse izbrane naprave hkrati, vrstice razdeljene po računskih enotah
+	if (ndev > 1) {
+		printf("\n%7s %12s %12s %12s %12s %12s %s\n",
+			"naprav", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160", "pohitritev");
+		fflush(stdout);
+
+		for (int n = 1; n <= ndev; n++) {
+			double t[n_images];
+			printf("%7d ", n); fflush(stdout);
+			for (int k = 0; k < n_images; k++) {
+				t[k] = cas_naprav(gpus, n, images[k], 16, 10);
+				if (n == 1) t_one[k] = t[k];
+				printf("%12lf ", t[k]); fflush(stdout);
+			}
+			for (int k = 0; k < n_images; k++)
+				printf("%.3lf%s", t_one[k] / t[k], k + 1 < n_images ? "," : "\n");
+		}
+	}
+
+	// jedra SIMD; ravni, ki jih procesor ne podpira, preskočimo
+	pthread_once(&simd_once, simd_detect);
+
+    printf("\n%7s %12s %12s %12s %12s %12s\n",
+		"jedro", "640x480", "800x600", "1600x900", "1920x1080", "3840x2160");
+	fflush(stdout);
+
+	for (int level = 0; level <= simd_level; level++) {
+		printf("%7s ", simd_names[level]); fflush(stdout);
+		for (int k = 0; k < n_images; k++) {
+			printf("%12lf ", cas_simd(images[k], level, 10)); fflush(stdout);
+		}
+		printf("\n");
+	}
+
+	for (int d = 0; d < ndev; d++)
+		cl_finalize(&gpus[d]);
 
 	return 0;
 }
@@ -1,8 +1,33 @@
 
+// Število košev na kanal določi gostitelj ob prevajanju (-DBINS, -DBIN_SHIFT):
+// vrednost v gre v koš v >> BIN_SHIFT, BINS = 256 >> BIN_SHIFT. Lokalni
+// histogrami imajo LOCAL_SIZE košev, globalni pa ostanejo razporejeni kot
+// histogram_t (SIZE, kanal na 256 uintov), koši od BINS naprej so 0.
+#ifndef BINS
+#define BINS 256
+#endif
+#ifndef BIN_SHIFT
+#define BIN_SHIFT 0
+#endif
 #define SIZE ((size_t) 3 * 256)
+#define LOCAL_SIZE ((size_t) 3 * BINS)
+#define BIN(v) ((v) >> BIN_SHIFT)
+
+// Praznjenje koša i lokalnega histograma (0 <= i < LOCAL_SIZE). Pri partial == 0
+// se prišteje globalnemu histogramu z atomarno operacijo, sicer pa skupina brez
+// atomarnih operacij zapiše svoj delni histogram v vrstico group tabele
+// num_groups x SIZE, ki jo sešteje reduce_histogram.
+void flush_bin(__global uint *hist_lin, uint i, uint value, uint partial, uint group)
+{
+    i = i / BINS * 256 + i % BINS;
+    if (partial)
+        hist_lin[group * SIZE + i] = value;
+    else if (value > 0)
+        atomic_add(&hist_lin[i], value);
+}
 
 __kernel void calc_histogram(__global const uchar *img, __global uint hist[3][256], 
-                             uint height, uint width)
+                             uint height, uint width, uint partial)
 {
     const uint g_i = get_global_id(0);
     const uint g_j = get_global_id(1);
@@ -10,20 +35,20 @@ __kernel void calc_histogram(__global const uchar *img, __global uint hist[3][25
     const uint l_i = get_local_id(0);
     const uint l_j = get_local_id(1);
 
-    const uint size_0 = min(get_local_size(0), SIZE);
-    const uint size_1 = min(get_local_size(1), SIZE);
+    const uint size_0 = min(get_local_size(0), LOCAL_SIZE);
+    const uint size_1 = min(get_local_size(1), LOCAL_SIZE);
     const uint size = size_0 * size_1;
 
     __global uint *hist_lin = hist;
 
-    __local uint hist_local[3][256];
+    __local uint hist_local[3][BINS];
     __local uint *hist_local_lin = hist_local;
 
     // nastavi lokalne histograme na 0
     #pragma unroll
-    for (uint l_off = 0; l_off < SIZE; l_off += size) {
-        const uint i = l_off + l_i * size_0 + l_j;
-        if (i >= SIZE) break;
+    for (uint l_off = 0; l_off < LOCAL_SIZE; l_off += size) {
+        const uint i = l_off + l_i * size_1 + l_j;
+        if (i >= LOCAL_SIZE) break;
 
         hist_local_lin[i] = 0;
     }
@@ -32,18 +57,439 @@ __kernel void calc_histogram(__global const uchar *img, __global uint hist[3][25
 
     if (g_i < height && g_j < width) {
         const uint pixel = 4 * (g_i * width + g_j);
-        atomic_add(&hist_local[0][img[pixel + 2]], 1);
-        atomic_add(&hist_local[1][img[pixel + 1]], 1);
-        atomic_add(&hist_local[2][img[pixel + 0]], 1);
+        atomic_add(&hist_local[0][BIN(img[pixel + 2])], 1);
+        atomic_add(&hist_local[1][BIN(img[pixel + 1])], 1);
+        atomic_add(&hist_local[2][BIN(img[pixel + 0])], 1);
     }
 
 	barrier(CLK_LOCAL_MEM_FENCE);
 
     #pragma unroll
-    for (uint l_off = 0; l_off < SIZE; l_off += size) {
-        const uint i = l_off + l_i * size_0 + l_j;
-        if (i >= SIZE) break;
+    for (uint l_off = 0; l_off < LOCAL_SIZE; l_off += size) {
+        const uint i = l_off + l_i * size_1 + l_j;
+        if (i >= LOCAL_SIZE) break;
+
+        flush_bin(hist_lin, i, hist_local_lin[i], partial, get_group_id(0) * get_num_groups(1) + get_group_id(1));
+    }
+}
+// Grobljenje niti: 1D zagon z omejenim številom skupin, vsaka nit obdela
+// vsak get_global_size(0)-ti piksel. Lokalni histogram se tako izprazni
+// v globalnega enkrat na skupino na sliko, ne enkrat na nekaj pikslov.
+__kernel void calc_histogram_coarse(__global const uchar *img, __global uint hist[3][256],
+                                    uint height, uint width, uint partial)
+{
+    const uint n = height * width;
+    const uint l_id = get_local_id(0);
+    const uint l_size = get_local_size(0);
+
+    __global uint *hist_lin = hist;
+
+    __local uint hist_local[3][BINS];
+    __local uint *hist_local_lin = hist_local;
+
+    // nastavi lokalne histograme na 0
+    for (uint i = l_id; i < LOCAL_SIZE; i += l_size)
+        hist_local_lin[i] = 0;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // sosednje niti berejo sosednje piksle
+    for (uint p = get_global_id(0); p < n; p += get_global_size(0)) {
+        const uint pixel = 4 * p;
+        atomic_add(&hist_local[0][BIN(img[pixel + 2])], 1);
+        atomic_add(&hist_local[1][BIN(img[pixel + 1])], 1);
+        atomic_add(&hist_local[2][BIN(img[pixel + 0])], 1);
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // prazne koše flush_bin preskoči, da prihranimo globalne atomarne operacije
+    for (uint i = l_id; i < LOCAL_SIZE; i += l_size)
+        flush_bin(hist_lin, i, hist_local_lin[i], partial, get_group_id(0));
+}
+
+// Vektorsko branje: vsaka nit z enim 16-bajtnim branjem (uint4) prebere
+// 4 sosednje piksle vrstice in kanale razpakira v registrih. Zadnja nit v
+// vrstici, kjer širina ni večkratnik 4, prebere preostale piksle posamično.
+__kernel void calc_histogram_vec(__global const uchar *img, __global uint hist[3][256],
+                                 uint height, uint width, uint partial)
+{
+    const uint g_i = get_global_id(0);
+    const uint g_j = get_global_id(1);
+
+    const uint l_i = get_local_id(0);
+    const uint l_j = get_local_id(1);
+
+    const uint size_0 = get_local_size(0);
+    const uint size_1 = get_local_size(1);
+    const uint size = size_0 * size_1;
+
+    __global uint *hist_lin = hist;
+    __global const uint *pixels = (__global const uint *) img;
+
+    __local uint hist_local[3][BINS];
+    __local uint *hist_local_lin = hist_local;
+
+    // nastavi lokalne histograme na 0
+    for (uint i = l_i * size_1 + l_j; i < LOCAL_SIZE; i += size)
+        hist_local_lin[i] = 0;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const uint j = 4 * g_j;
+    if (g_i < height && j < width) {
+        __global const uint *row = pixels + g_i * width;
+
+        if (j + 4 <= width) {
+            const uint4 p = vload4(0, row + j);
+            atomic_add(&hist_local[0][BIN((p.x >> 16) & 0xFF)], 1);
+            atomic_add(&hist_local[1][BIN((p.x >>  8) & 0xFF)], 1);
+            atomic_add(&hist_local[2][BIN( p.x        & 0xFF)], 1);
+            atomic_add(&hist_local[0][BIN((p.y >> 16) & 0xFF)], 1);
+            atomic_add(&hist_local[1][BIN((p.y >>  8) & 0xFF)], 1);
+            atomic_add(&hist_local[2][BIN( p.y        & 0xFF)], 1);
+            atomic_add(&hist_local[0][BIN((p.z >> 16) & 0xFF)], 1);
+            atomic_add(&hist_local[1][BIN((p.z >>  8) & 0xFF)], 1);
+            atomic_add(&hist_local[2][BIN( p.z        & 0xFF)], 1);
+            atomic_add(&hist_local[0][BIN((p.w >> 16) & 0xFF)], 1);
+            atomic_add(&hist_local[1][BIN((p.w >>  8) & 0xFF)], 1);
+            atomic_add(&hist_local[2][BIN( p.w        & 0xFF)], 1);
+        }
+        else {
+            for (uint k = j; k < width; k++) {
+                const uint p = row[k];
+                atomic_add(&hist_local[0][BIN((p >> 16) & 0xFF)], 1);
+                atomic_add(&hist_local[1][BIN((p >>  8) & 0xFF)], 1);
+                atomic_add(&hist_local[2][BIN( p        & 0xFF)], 1);
+            }
+        }
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const uint group = get_group_id(0) * get_num_groups(1) + get_group_id(1);
+    for (uint i = l_i * size_1 + l_j; i < LOCAL_SIZE; i += size)
+        flush_bin(hist_lin, i, hist_local_lin[i], partial, group);
+}
+
+// Replicirani lokalni histogrami: skupina ima copies kopij v lokalnem
+// pomnilniku (argument hist_local, copies * LOCAL_SIZE uintov), sosednje niti
+// pišejo v različne kopije. Pri enobarvnih slikah se atomarne operacije
+// tako porazdelijo na copies naslovov namesto enega. Kopije se pred
+// praznjenjem v globalni histogram seštejejo. Zagon je 1D kot pri coarse.
+__kernel void calc_histogram_repl(__global const uchar *img, __global uint hist[3][256],
+                                  uint height, uint width, uint partial,
+                                  __local uint *hist_local, uint copies)
+{
+    const uint n = height * width;
+    const uint l_id = get_local_id(0);
+    const uint l_size = get_local_size(0);
+
+    __global uint *hist_lin = hist;
+    __local uint *mine = hist_local + (l_id % copies) * LOCAL_SIZE;
+
+    // nastavi lokalne histograme na 0
+    for (uint i = l_id; i < copies * LOCAL_SIZE; i += l_size)
+        hist_local[i] = 0;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint p = get_global_id(0); p < n; p += get_global_size(0)) {
+        const uint pixel = 4 * p;
+        atomic_add(&mine[0 * BINS + BIN(img[pixel + 2])], 1);
+        atomic_add(&mine[1 * BINS + BIN(img[pixel + 1])], 1);
+        atomic_add(&mine[2 * BINS + BIN(img[pixel + 0])], 1);
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // seštevanje kopij in praznjenje v globalni histogram
+    for (uint i = l_id; i < LOCAL_SIZE; i += l_size) {
+        uint sum = 0;
+        for (uint c = 0; c < copies; c++)
+            sum += hist_local[c * LOCAL_SIZE + i];
+        flush_bin(hist_lin, i, sum, partial, get_group_id(0));
+    }
+}
+
+// Stisnjeni piksli BGR (3 bajti, brez alfe): 1D zagon kot pri coarse, vsaka
+// nit z vload3 prebere tri uinte = 4 piksle naenkrat. Na napravah little
+// endian so bajti b0 g0 r0 b1 | g1 r1 b2 g2 | r2 b3 g3 r3. Piksle, ki ne
+// sestavijo cele četverice, preberemo posamično.
+__kernel void calc_histogram_rgb(__global const uchar *img, __global uint hist[3][256],
+                                 uint height, uint width, uint partial)
+{
+    const uint n = height * width;
+    const uint quads = n / 4;
+    const uint l_id = get_local_id(0);
+    const uint l_size = get_local_size(0);
+
+    __global uint *hist_lin = hist;
+    __global const uint *words = (__global const uint *) img;
+
+    __local uint hist_local[3][BINS];
+    __local uint *hist_local_lin = hist_local;
+
+    // nastavi lokalne histograme na 0
+    for (uint i = l_id; i < LOCAL_SIZE; i += l_size)
+        hist_local_lin[i] = 0;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint q = get_global_id(0); q < quads; q += get_global_size(0)) {
+        const uint3 w = vload3(q, words);
+        atomic_add(&hist_local[0][BIN((w.x >> 16) & 0xFF)], 1);
+        atomic_add(&hist_local[1][BIN((w.x >>  8) & 0xFF)], 1);
+        atomic_add(&hist_local[2][BIN( w.x        & 0xFF)], 1);
+        atomic_add(&hist_local[0][BIN((w.y >>  8) & 0xFF)], 1);
+        atomic_add(&hist_local[1][BIN( w.y        & 0xFF)], 1);
+        atomic_add(&hist_local[2][BIN( w.x >> 24       )], 1);
+        atomic_add(&hist_local[0][BIN( w.z        & 0xFF)], 1);
+        atomic_add(&hist_local[1][BIN( w.y >> 24       )], 1);
+        atomic_add(&hist_local[2][BIN((w.y >> 16) & 0xFF)], 1);
+        atomic_add(&hist_local[0][BIN( w.z >> 24       )], 1);
+        atomic_add(&hist_local[1][BIN((w.z >> 16) & 0xFF)], 1);
+        atomic_add(&hist_local[2][BIN((w.z >>  8) & 0xFF)], 1);
+    }
+
+    for (uint p = 4 * quads + get_global_id(0); p < n; p += get_global_size(0)) {
+        const uint pixel = 3 * p;
+        atomic_add(&hist_local[0][BIN(img[pixel + 2])], 1);
+        atomic_add(&hist_local[1][BIN(img[pixel + 1])], 1);
+        atomic_add(&hist_local[2][BIN(img[pixel + 0])], 1);
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint i = l_id; i < LOCAL_SIZE; i += l_size)
+        flush_bin(hist_lin, i, hist_local_lin[i], partial, get_group_id(0));
+}
+
+// Histogrami izrezov v enem prehodu: izrez r (x, y, širina, višina) obdelajo
+// skupine (g, r) za g < get_num_groups(0), vsaka vsako parts-to vrstico, sosednje
+// niti berejo sosednje piksle vrstice. Skupina tako bere le piksle enega izreza
+// in lokalni histogram izprazni v njegovo vrstico hist (num_rects x SIZE), ki jo
+// gostitelj pred prvim pasom postavi na 0. Medpomnilnik img drži vrstice
+// [row0, row0 + rows) slike s širino width in bpp bajti na piksel.
+__kernel void calc_histogram_rects(__global const uchar *img, __global uint *hist, __global const uint4 *rects,
+                                   uint width, uint bpp, uint row0, uint rows)
+{
+    const uint l_id = get_local_id(0);
+    const uint l_size = get_local_size(0);
+    const uint part = get_group_id(0);
+    const uint parts = get_num_groups(0);
+    const uint r = get_global_id(1);
+    const uint4 rect = rects[r];
+
+    __local uint hist_local[3][BINS];
+    __local uint *hist_local_lin = hist_local;
+
+    // nastavi lokalne histograme na 0
+    for (uint i = l_id; i < LOCAL_SIZE; i += l_size)
+        hist_local_lin[i] = 0;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // vrstice izreza, ki so v tem pasu
+    const uint first = max(rect.y, row0);
+    const uint last = min(rect.y + rect.w, row0 + rows);
+    for (uint y = first + part; y < last; y += parts) {
+        __global const uchar *row = img + ((y - row0) * width + rect.x) * bpp;
+        for (uint x = l_id; x < rect.z; x += l_size) {
+            const uint pixel = bpp * x;
+            atomic_add(&hist_local[0][BIN(row[pixel + 2])], 1);
+            atomic_add(&hist_local[1][BIN(row[pixel + 1])], 1);
+            atomic_add(&hist_local[2][BIN(row[pixel + 0])], 1);
+        }
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint i = l_id; i < LOCAL_SIZE; i += l_size)
+        flush_bin(hist + r * SIZE, i, hist_local_lin[i], 0, 0);
+}
+
+// Vključujoča kumulativna vsota 256 košev v lokalnem pomnilniku (Hillis-Steele);
+// kličejo jo vse niti skupine s 256 nitmi, i je lokalni indeks.
+void scan_bins(__local uint *cdf, uint i)
+{
+    for (uint d = 1; d < 256; d <<= 1) {
+        const uint v = i >= d ? cdf[i - d] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        cdf[i] += v;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+// LUT izenačenja histograma: skupina 256 niti na kanal (get_global_id(1)) naredi
+// vključujočo kumulativno vsoto (CDF) s scan_bins v lokalnem pomnilniku in
+// koš i preslika v round((cdf[i] - cdf_min) * 255 / (n - cdf_min)), kjer je cdf_min
+// CDF prvega nepraznega koša. Enobarven kanal ostane nespremenjen. lut ima isto
+// razporeditev kot hist (R, G, B).
+__kernel void calc_lut(__global const uint *hist, __global uchar *lut)
+{
+    const uint i = get_local_id(0);
+    const uint c = get_global_id(1);
+
+    __local uint cdf[256];
+    __local uint cdf_min;
+
+    cdf[i] = hist[c * 256 + i];
+    if (i == 0)
+        cdf_min = 0;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    scan_bins(cdf, i);
+
+    // prvi neprazni koš je edini, pred katerim je CDF 0
+    if (cdf[i] > 0 && (i == 0 || cdf[i - 1] == 0))
+        cdf_min = cdf[i];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const ulong range = cdf[255] - cdf_min;
+    const ulong above = max(cdf[i], cdf_min) - cdf_min;
+    lut[c * 256 + i] = range == 0 ? i : (uchar) ((above * 255 + range / 2) / range);
+}
+
+// Preslikava n pikslov z bpp bajti (BGRA ali BGR) skozi LUT iz calc_lut; 1D
+// zagon kot pri coarse. LUT se najprej prebere v lokalni pomnilnik, alfa se prepiše.
+__kernel void apply_lut(__global const uchar *img, __global uchar *out, __global const uchar *lut,
+                        uint n, uint bpp)
+{
+    const uint l_id = get_local_id(0);
+    const uint l_size = get_local_size(0);
 
-        atomic_add(&hist_lin[i], hist_local_lin[i]);
+    __local uchar lut_local[SIZE];
+
+    for (uint i = l_id; i < SIZE; i += l_size)
+        lut_local[i] = lut[i];
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint p = get_global_id(0); p < n; p += get_global_size(0)) {
+        const uint pixel = bpp * p;
+        out[pixel + 0] = lut_local[2 * 256 + img[pixel + 0]];
+        out[pixel + 1] = lut_local[1 * 256 + img[pixel + 1]];
+        out[pixel + 2] = lut_local[0 * 256 + img[pixel + 2]];
+        if (bpp == 4)
+            out[pixel + 3] = img[pixel + 3];
     }
-}
\ No newline at end of file
+}
+
+// LUT ploščic za CLAHE: skupina 256 niti na (ploščico, kanal) = (get_global_id(1) / 3,
+// get_global_id(1) % 3). Koši nad mejo se porežejo, presežek se razdeli enakomerno
+// (ostanek po en na prve koše), nato LUT = round(cdf * 255 / ploščina). Meja je
+// clip / 65536 * ploščina (clip = faktor * 256 glede na povprečni koš), pri clip == 0
+// ni rezanja. hist in lut imata po ploščicah razporeditev histogram_t (R, G, B).
+__kernel void clip_lut(__global const uint *hist, __global uchar *lut, __global const uint4 *rects, uint clip)
+{
+    const uint i = get_local_id(0);
+    const uint t = get_global_id(1) / 3;
+    const uint c = get_global_id(1) % 3;
+    const uint4 rect = rects[t];
+    const uint area = rect.z * rect.w;
+    const uint limit = clip == 0 ? area : max(1u, (uint) (((ulong) area * clip) >> 16));
+
+    __local uint cdf[256];
+    __local uint excess;
+
+    if (i == 0)
+        excess = 0;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const uint h = hist[(t * 3 + c) * 256 + i];
+    if (h > limit)
+        atomic_add(&excess, h - limit);
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    cdf[i] = min(h, limit) + excess / 256 + (i < excess % 256 ? 1 : 0);
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    scan_bins(cdf, i);
+
+    lut[(t * 3 + c) * 256 + i] = area == 0 ? i : (uchar) (((ulong) cdf[i] * 255 + area / 2) / area);
+}
+
+// Sosednji ploščici t0, t1 in utež w (0..256) druge za koordinato x na stranici
+// dolžine size s tiles ploščicami: središče piksla x + 1/2 se primerja s središči
+// ploščic (t + 1/2) * size / tiles. Pred prvim in za zadnjim središčem je t0 == t1.
+void clahe_axis(uint x, uint size, uint tiles, uint *t0, uint *t1, uint *w)
+{
+    const ulong pos = (2 * (ulong) x + 1) * tiles;
+    const ulong den = 2 * (ulong) size;
+
+    *t0 = *t1 = *w = 0;
+    if (pos <= size)
+        return;
+    *t0 = (pos - size) / den;
+    *t1 = *t0 + 1;
+    *w = (pos - size) % den * 256 / den;
+    if (*t1 >= tiles) {
+        *t0 = *t1 = tiles - 1;
+        *w = 0;
+    }
+}
+
+// CLAHE: piksel (x, row0 + y) se preslika z bilinearno interpolacijo LUT štirih
+// najbližjih ploščic v celoštevilski aritmetiki (uteži na 1/256). 2D zagon
+// (stolpec, vrstica v pasu); img in out držita vrstice [row0, row0 + rows).
+__kernel void apply_clahe(__global const uchar *img, __global uchar *out, __global const uchar *lut,
+                          uint width, uint height, uint row0, uint rows, uint bpp, uint tiles_x, uint tiles_y)
+{
+    const uint x = get_global_id(0);
+    const uint y = get_global_id(1);
+
+    if (x >= width || y >= rows)
+        return;
+
+    uint tx0, tx1, wx, ty0, ty1, wy;
+    clahe_axis(x, width, tiles_x, &tx0, &tx1, &wx);
+    clahe_axis(row0 + y, height, tiles_y, &ty0, &ty1, &wy);
+
+    __global const uchar *l00 = lut + (ty0 * tiles_x + tx0) * SIZE;
+    __global const uchar *l01 = lut + (ty0 * tiles_x + tx1) * SIZE;
+    __global const uchar *l10 = lut + (ty1 * tiles_x + tx0) * SIZE;
+    __global const uchar *l11 = lut + (ty1 * tiles_x + tx1) * SIZE;
+
+    // bajt k piksla je kanal 2 - k (B, G, R)
+    const uint pixel = (y * width + x) * bpp;
+    for (uint k = 0; k < 3; k++) {
+        const uint i = (2 - k) * 256 + img[pixel + k];
+        const uint top = (256 - wx) * l00[i] + wx * l01[i];
+        const uint bottom = (256 - wx) * l10[i] + wx * l11[i];
+        out[pixel + k] = ((256 - wy) * top + wy * bottom + 32768) >> 16;
+    }
+    if (bpp == 4)
+        out[pixel + 3] = img[pixel + 3];
+}
+
+// Drugi korak dvofaznega seštevanja: delovna enota (i, s) sešteje koš i
+// skupin [s * chunk, (s + 1) * chunk) iz partial v vrstico s tabele out.
+// Gostitelj ponavlja korak, dokler ne ostane ena vrstica - končni histogram.
+// Pri accumulate se vsota prišteje k out (pasovi ene slike).
+__kernel void reduce_histogram(__global const uint *partial, __global uint *out,
+                               uint groups, uint chunk, uint accumulate)
+{
+    const uint i = get_global_id(0);
+    const uint s = get_global_id(1);
+
+    if (i >= SIZE) return;
+
+    const uint first = s * chunk;
+    const uint last = min(first + chunk, groups);
+
+    // koši od BINS naprej v partial niso zapisani in ostanejo 0
+    uint sum = 0;
+    for (uint g = first; i % 256 < BINS && g < last; g++)
+        sum += partial[g * SIZE + i];
+
+    if (accumulate)
+        out[s * SIZE + i] += sum;
+    else
+        out[s * SIZE + i] = sum;
+}
@@ -0,0 +1,240 @@
+#ifndef HISTOGRAM_INTERNAL_H
+#define HISTOGRAM_INTERNAL_H
+
+// Notranji vmesnik libhistogram za priložene programe (merjenje, uglaševanje,
+// serije); ni del stabilnega API-ja v libhistogram.h in se lahko spreminja.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <CL/cl.h>
+#include "libhistogram.h"
+
+#define BINS 256            // košev na kanal v histogram_t; naprava jih lahko šteje manj (gpu_t.bins)
+#define BUILD_OPTIONS "-DBINS=%u -DBIN_SHIFT=%u"
+#define MAX_DEVICES 16
+#define GROUPS_PER_CU 8     // delovnih skupin na računsko enoto pri 1D zagonu
+#define MAX_COPIES 256      // največ kopij lokalnega histograma
+#define TWO_PHASE_MIN_GROUPS 64             // pod tem številom skupin so globalne atomarne operacije poceni
+#define TWO_PHASE_MAX_BYTES (64 << 20)      // največja tabela delnih histogramov
+#define REDUCE_CHUNK 64                     // skupin, ki jih sešteje ena delovna enota reduce_histogram
+#define HYBRID_EMA 0.3                      // utež zadnje meritve v drsečem povprečju hitrosti
+#define HYBRID_INITIAL 0.25                 // delež vrstic za CPE, dokler ni meritev
+#define HYBRID_MIN_SHARE 0.02               // najmanjši delež vsake strani, da se hitrost še meri
+#define TUNE_CLASSES 40                     // razredi velikosti slike: floor(log2(pikslov))
+#define TUNE_SAMPLES 3                      // meritev na nastavitev pri uglaševanju
+#define TUNE_DEFAULT_SIDE 16                // kvadratna skupina, dokler razred ni uglašen
+#define TILE_STRIP_BYTES (64 << 20)         // privzeta velikost pasu vrstic pri pretakanju (HIST_STRIP_MB)
+#define TILE_STRIPS 3                       // privzeto število medpomnilnikov v obroču (HIST_STRIPS)
+#define TILE_MAX_STRIPS 8
+
+// različice kernela za histogram
+enum { KERNEL_BASIC, KERNEL_COARSE, KERNEL_VEC, KERNEL_REPL, KERNELS };
+extern const char *kernel_names[KERNELS];
+
+// dogodki enega klica histogramGPU za profiliranje; redukcija ima lahko več
+// korakov, zato hranimo prvega in zadnjega
+enum { EV_UPLOAD, EV_FILL, EV_KERNEL, EV_REDUCE_FIRST, EV_REDUCE_LAST, EV_READ, EVENTS };
+enum { PHASE_UPLOAD, PHASE_FILL, PHASE_KERNEL, PHASE_REDUCE, PHASE_READ, PHASES };
+extern const char *phase_names[PHASES];
+
+// izmerjeni časi faz v sekundah
+typedef struct
+{
+	double *t[PHASES];
+	size_t n[PHASES], cap[PHASES];
+	size_t bytes_up, bytes_down, pixels;
+}
+profile_t;
+
+// nastavitev zagona: različica kernela in oblika delovne skupine (rows x cols);
+// 1D različice uporabijo rows * cols niti v eni dimenziji
+typedef struct
+{
+	int variant;            // < 0: ni nastavitve
+	uint32_t rows, cols;
+	double seconds;         // izmerjeni čas pri uglaševanju
+}
+config_t;
+
+// način praznjenja lokalnih histogramov
+enum { REDUCE_AUTO, REDUCE_ATOMIC, REDUCE_TWO_PHASE };
+
+// kdaj histogramGPU pretaka sliko po pasovih; pri TILED_AUTO le, ko slika ne gre v en medpomnilnik
+enum { TILED_AUTO, TILED_OFF, TILED_ON };
+
+// stanje ene naprave OpenCL; medpomnilnik slike ostane med klici in se
+// poveča le, ko pride večja slika
+typedef struct
+{
+	cl_device_id device;
+	cl_context context;
+	cl_program program;
+	cl_command_queue command_queue;
+	cl_kernel kernels[KERNELS];
+	size_t max_wg[KERNELS]; // CL_KERNEL_WORK_GROUP_SIZE za vsako različico
+	int variant;            // kernel, ki ga uporablja histogramGPU
+	cl_uint compute_units;
+	uint32_t coarsening;    // pikslov na nit pri zadnjem zagonu
+	cl_ulong local_mem;
+	uint32_t bins;          // košev na kanal (potenca 2 do BINS), v kernelih -DBINS
+	uint32_t copies;        // kopij lokalnega histograma v calc_histogram_repl
+	cl_mem hist_mem_obj;
+	cl_mem img_mem_obj;
+	size_t img_capacity;
+	int reduce;             // REDUCE_*; pri REDUCE_AUTO odloča število skupin
+	bool two_phase;         // ali je zadnji zagon uporabil dvofazno seštevanje
+	cl_kernel reduce_kernel;
+	cl_kernel rgb_kernel;   // calc_histogram_rgb za stisnjene piksle BGR
+	size_t rgb_max_wg;
+	bool packed;            // slika ima 3 bajte na piksel (histogramGPU_rgb)
+	cl_kernel rects_kernel; // calc_histogram_rects za histograme izrezov
+	size_t rects_max_wg;
+	cl_mem rects_mem_obj;   // izrezi (uint4) in njihovi histogrami; povečata se ob več izrezih
+	size_t rects_capacity;
+	cl_mem tiles_mem_obj;
+	size_t tiles_capacity;
+	cl_kernel lut_kernel;   // calc_lut in apply_lut za izenačenje histograma
+	size_t lut_max_wg;
+	cl_kernel apply_kernel;
+	size_t apply_max_wg;
+	cl_mem lut_mem_obj;
+	size_t lut_capacity;
+	cl_mem eq_mem_obj;      // izenačena slika, ki se prebere na gostitelja
+	size_t eq_capacity;
+	cl_kernel clip_kernel;  // clip_lut in apply_clahe za CLAHE
+	size_t clip_max_wg;
+	cl_kernel clahe_kernel;
+	size_t clahe_max_wg;
+	cl_mem partial_mem_obj[2];
+	size_t partial_capacity[2];
+	bool profiling;         // ukazna vrsta s CL_QUEUE_PROFILING_ENABLE
+	profile_t profile;
+	FILE *profile_csv;
+	bool zero_copy;         // slika se ne kopira, kernel bere neposredno iz pomnilnika gostitelja
+	size_t img_align;       // poravnava slik za CL_MEM_USE_HOST_PTR
+	size_t base_align;      // najmanjša poravnava naslova za ovoj (CL_DEVICE_MEM_BASE_ADDR_ALIGN)
+	double rate_cpu;        // pikslov na sekundo v hibridnem načinu (drseče povprečje), 0 = še ni meritve
+	double rate_gpu;
+	double hybrid_share;    // delež vrstic za CPE pri zadnji sliki
+	config_t tuned[TUNE_CLASSES];   // najboljša nastavitev po razredu velikosti slike
+	const config_t *trial;  // med uglaševanjem: nastavitev, ki se meri
+	cl_ulong max_alloc;     // CL_DEVICE_MAX_MEM_ALLOC_SIZE
+	int tiled;              // TILED_*
+	size_t strip_bytes;     // največ bajtov v enem pasu; naprava ima hkrati največ strips pasov
+	uint32_t strips;
+	cl_mem strip_mem_obj[TILE_MAX_STRIPS];
+	size_t strip_capacity[TILE_MAX_STRIPS];
+	cl_command_queue upload_queue;  // prenosi pasov, da se prekrivajo s kerneli; ustvari se ob prvi uporabi
+	bool accumulate;        // enqueue_histogram prišteje k hist_mem_obj, namesto da ga prepiše
+	size_t pitch;           // bajtov med vrsticami slike v histogramGPU; 0 = strnjene vrstice
+}
+gpu_t;
+
+// prišteje v H rows vrstic po width pikslov; vrstice se začnejo pitch bajtov narazen
+typedef void (*pixels_fn)(histogram_t *H, const uint8_t *pixels, size_t width, size_t rows, size_t pitch);
+
+// slika, preslikana iz datoteke (map_image); pixels kaže v preslikavo ali v buffer
+typedef struct
+{
+	const uint8_t *pixels;
+	uint32_t width, height;
+	uint32_t bpp;           // 3 (BGR) ali 4 (BGRA)
+	bool swap_rb;           // kanala R in B sta zamenjana (PPM, *.rgb, *.rgba)
+	void *map;
+	size_t map_size;
+	uint8_t *buffer;        // pretvorjena sličica Y4M, sicer NULL
+}
+mapped_t;
+
+enum { MAPPED_NO, MAPPED_OK, MAPPED_ERROR };
+
+// stopnje SIMD: 0 = skalarno, 1 = SSE2, 2 = AVX2; simd_level je najvišja, ki jo procesor podpira
+extern const char *simd_names[];
+extern const pixels_fn simd_fns[];
+extern int simd_level;
+extern pthread_once_t simd_once;
+extern bool hist_verbose;   // izpis stanja inicializacije na stdout
+
+const char *cl_error(int status);
+
+// naprave
+void print_devices();
+int cl_init_devices(gpu_t *gpus, int max, const char *spec);
+int cl_init_devices_bins(gpu_t *gpus, int max, const char *spec, uint32_t bins);
+int cl_init(gpu_t *gpu);
+void cl_finalize(gpu_t *gpu);
+
+// CPE
+void histogramCPU(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize);
+void histogramCPU_rgb(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize);
+void simd_detect();
+void histogramSIMD(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize);
+uint32_t cpu_threads();
+void histogramCPU_MT(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t threads);
+void histogramCPU_MT_rgb(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t threads);
+void histogramCPU_pitch(histogram_t *H, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch,
+                        uint32_t bpp, uint32_t threads, bool scalar);
+bool valid_bins(uint32_t bins);
+void fold_bins(histogram_t *H, size_t n, uint32_t bins);
+void histogramCPU_rects(histogram_t *H, const uint8_t *image, size_t pitch, uint32_t bpp,
+                        const hist_rect_t *rects, uint32_t n, uint32_t threads, bool scalar);
+void equalize_lut(const histogram_t *H, uint8_t lut[3][BINS]);
+void equalizeCPU(uint8_t *out, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch, uint32_t bpp,
+                 uint32_t threads, bool scalar);
+void grid_rects(hist_rect_t *tiles, uint32_t width, uint32_t height, uint32_t tiles_x, uint32_t tiles_y);
+uint32_t clahe_clip(float clip_limit);
+void clahe_lut(const histogram_t *H, uint32_t area, uint32_t clip, uint8_t lut[3][BINS]);
+void claheCPU(uint8_t *out, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch, uint32_t bpp,
+              uint32_t tiles_x, uint32_t tiles_y, float clip_limit, uint32_t threads, bool scalar);
+
+// GPE
+uint8_t *image_alloc(gpu_t *gpu, size_t size);
+uint32_t size_class(uint32_t width, uint32_t height);
+config_t launch_config(gpu_t *gpu, uint32_t width, uint32_t height, uint32_t wgsize);
+cl_int enqueue_histogram(gpu_t *gpu, cl_command_queue queue, cl_mem img_mem_obj, cl_mem hist_mem_obj,
+                         uint32_t width, uint32_t height, uint32_t wgsize, cl_uint num_wait, const cl_event *wait,
+                         cl_event *events);
+cl_int enqueue_image(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize,
+                     cl_bool blocking, cl_mem *wrap, cl_event *ev);
+cl_int histogramGPU(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize);
+cl_int histogramGPU_rgb(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize);
+cl_int histogramGPU_pitch(gpu_t *gpu, histogram_t *H, const uint8_t *image, uint32_t width, uint32_t height,
+                          size_t pitch, uint32_t bpp, uint32_t wgsize);
+cl_int histogramGPU_rects(gpu_t *gpu, histogram_t *H, const uint8_t *image, uint32_t width, uint32_t height,
+                          size_t pitch, uint32_t bpp, const hist_rect_t *rects, uint32_t n, uint32_t wgsize);
+cl_int equalizeGPU(gpu_t *gpu, uint8_t *out, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch,
+                   uint32_t bpp, uint32_t wgsize);
+cl_int claheGPU(gpu_t *gpu, uint8_t *out, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch,
+                uint32_t bpp, uint32_t tiles_x, uint32_t tiles_y, float clip_limit, uint32_t wgsize);
+cl_int histogram_tiled(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize);
+cl_int histogram_stream(gpu_t *gpu, histogram_t *H, hist_rows_fn read_rows, void *ctx,
+                        uint32_t width, uint32_t height, uint32_t wgsize);
+cl_int histogramGPU_multi(gpu_t *gpus, int n, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height,
+                          uint32_t wgsize);
+cl_int histogram_hybrid(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize);
+void profile_report(profile_t *prof, const char *label, FILE *csv);
+
+// uglaševanje
+config_t autotune(gpu_t *gpu, uint8_t *image, uint32_t width, uint32_t height);
+void tuning_save(gpu_t *gpu);
+
+// slike in serije
+bool decode_image(gpu_t *gpu, const char *filename, uint8_t **image, size_t *capacity, uint32_t *width, uint32_t *height);
+bool decode_image_rgb(gpu_t *gpu, const char *filename, uint8_t **image, size_t *capacity, uint32_t *width, uint32_t *height);
+int map_image(const char *filename, mapped_t *img);
+void unmap_image(mapped_t *img);
+cl_int histogram_mapped(gpu_t *gpu, histogram_t *H, const mapped_t *img, uint32_t wgsize);
+bool decode_image_scaled(gpu_t *gpu, const char *filename, uint32_t scale, uint8_t **image, size_t *capacity,
+                         uint32_t *width, uint32_t *height, uint64_t *full);
+void scale_counts(histogram_t *H, uint64_t full, uint64_t pixels);
+void histogram_batch(gpu_t *gpu, const char **files, int n, histogram_t *results, bool *ok, uint32_t wgsize,
+                     uint32_t decoders, uint32_t scale);
+void histogram_batch_multi(gpu_t *gpus, int ndev, const char **files, int n, histogram_t *results, bool *ok,
+                           uint32_t wgsize, uint32_t decoders, uint32_t scale);
+const char **collect_images(int argc, const char **argv, int *n);
+
+void printHistogram(histogram_t *H);
+bool equal(histogram_t *A, histogram_t *B);
+
+#endif
@@ -0,0 +1,3649 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <math.h>
+#include <CL/cl.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <strings.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include "FreeImage.h"
+#include "histogram_internal.h"
+#include "histogram_cl.h"
+
+const uint32_t zero = 0U;
+
+const char *kernel_names[KERNELS] = { "calc_histogram", "calc_histogram_coarse", "calc_histogram_vec", "calc_histogram_repl" };
+const char *phase_names[PHASES] = { "upload", "fill", "kernel", "reduce", "readback" };
+
+bool hist_verbose = false;
+
+#define LOG(...) do { if (hist_verbose) printf(__VA_ARGS__); } while (0)
+
+// pas vrstic [row_begin, row_end), ki ga obdela ena nit
+typedef struct
+{
+	histogram_t H;
+	const uint8_t *image;
+	uint32_t width, row_begin, row_end;
+	uint32_t bpp;           // bajtov na piksel
+	size_t pitch;           // bajtov med začetki vrstic
+	pixels_fn count;        // jedro za bpp
+}
+band_t;
+
+static const char *errors[] = {
+    "CL_SUCCESS"                                      ,
+    "CL_DEVICE_NOT_FOUND"                             ,
+    "CL_DEVICE_NOT_AVAILABLE"                         ,
+    "CL_COMPILER_NOT_AVAILABLE"                       ,
+    "CL_MEM_OBJECT_ALLOCATION_FAILURE"                ,
+    "CL_OUT_OF_RESOURCES"                             ,
+    "CL_OUT_OF_HOST_MEMORY"                           ,
+    "CL_PROFILING_INFO_NOT_AVAILABLE"                 ,
+    "CL_MEM_COPY_OVERLAP"                             ,
+    "CL_IMAGE_FORMAT_MISMATCH"                        ,
+    "CL_IMAGE_FORMAT_NOT_SUPPORTED"                   ,
+    "CL_BUILD_PROGRAM_FAILURE"                        ,
+    "CL_MAP_FAILURE"                                  ,
+    "CL_MISALIGNED_SUB_BUFFER_OFFSET"                 ,
+    "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST"    ,
+    "CL_COMPILE_PROGRAM_FAILURE"                      ,
+    "CL_LINKER_NOT_AVAILABLE"                         ,
+    "CL_LINK_PROGRAM_FAILURE"                         ,
+    "CL_DEVICE_PARTITION_FAILED"                      ,
+    "CL_KERNEL_ARG_INFO_NOT_AVAILABLE"                ,
+    "CL_INVALID_VALUE"                                ,
+    "CL_INVALID_DEVICE_TYPE"                          ,
+    "CL_INVALID_PLATFORM"                             ,
+    "CL_INVALID_DEVICE"                               ,
+    "CL_INVALID_CONTEXT"                              ,
+    "CL_INVALID_QUEUE_PROPERTIES"                     ,
+    "CL_INVALID_COMMAND_QUEUE"                        ,
+    "CL_INVALID_HOST_PTR"                             ,
+    "CL_INVALID_MEM_OBJECT"                           ,
+    "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR"              ,
+    "CL_INVALID_IMAGE_SIZE"                           ,
+    "CL_INVALID_SAMPLER"                              ,
+    "CL_INVALID_BINARY"                               ,
+    "CL_INVALID_BUILD_OPTIONS"                        ,
+    "CL_INVALID_PROGRAM"                              ,
+    "CL_INVALID_PROGRAM_EXECUTABLE"                   ,
+    "CL_INVALID_KERNEL_NAME"                          ,
+    "CL_INVALID_KERNEL_DEFINITION"                    ,
+    "CL_INVALID_KERNEL"                               ,
+    "CL_INVALID_ARG_INDEX"                            ,
+    "CL_INVALID_ARG_VALUE"                            ,
+    "CL_INVALID_ARG_SIZE"                             ,
+    "CL_INVALID_KERNEL_ARGS"                          ,
+    "CL_INVALID_WORK_DIMENSION"                       ,
+    "CL_INVALID_WORK_GROUP_SIZE"                      ,
+    "CL_INVALID_WORK_ITEM_SIZE"                       ,
+    "CL_INVALID_GLOBAL_OFFSET"                        ,
+    "CL_INVALID_EVENT_WAIT_LIST"                      ,
+    "CL_INVALID_EVENT"                                ,
+    "CL_INVALID_OPERATION"                            ,
+    "CL_INVALID_GL_OBJECT"                            ,
+    "CL_INVALID_BUFFER_SIZE"                          ,
+    "CL_INVALID_MIP_LEVEL"                            ,
+    "CL_INVALID_GLOBAL_WORK_SIZE"                     ,
+    "CL_INVALID_PROPERTY"                             ,
+    "CL_INVALID_IMAGE_DESCRIPTOR"                     ,
+    "CL_INVALID_COMPILER_OPTIONS"                     ,
+    "CL_INVALID_LINKER_OPTIONS"                       ,
+    "CL_INVALID_DEVICE_PARTITION_COUNT"               ,
+};
+
+// tabela nima kod od -20 do -29, CL_INVALID_VALUE (-30) je na indeksu 20
+const char *cl_error(int status)
+{
+    const int n = sizeof(errors) / sizeof(errors[0]);
+    if (status <= 0 && status > -20)
+        return errors[-status];
+    if (status <= -30 && -status - 10 < n)
+        return errors[-status - 10];
+    return "CL_UNKNOWN_ERROR";
+}
+
+static uint32_t max(const uint32_t a, const uint32_t b) { return a >= b ? a : b; }
+static size_t min(const size_t a, const size_t b) { return a <= b ? a : b; }
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+// imenik za predpomnilnik in datoteko z uglašenimi nastavitvami; ustvari ga, če ga ni
+static bool cache_dir(char *dir, size_t len)
+{
+	const char *env;
+	if ((env = getenv("HIST_CACHE_DIR")))
+		snprintf(dir, len, "%s", env);
+	else if ((env = getenv("XDG_CACHE_HOME")))
+		snprintf(dir, len, "%s/histogram", env);
+	else if ((env = getenv("HOME"))) {
+		snprintf(dir, len, "%s/.cache", env);
+		mkdir(dir, 0755);
+		snprintf(dir, len, "%s/.cache/histogram", env);
+	}
+	else
+		return false;
+	mkdir(dir, 0755);
+
+	return true;
+}
+
+// Pot do prevedenega programa v predpomnilniku. Ključ je zgoščena vrednost
+// imena naprave, različice gonilnika, zastavic prevajanja in izvorne kode.
+// Imenik je HIST_CACHE_DIR, $XDG_CACHE_HOME/histogram ali ~/.cache/histogram;
+// HIST_CACHE=0 predpomnilnik izklopi.
+static bool cache_path(cl_device_id device, const char *source, const char *options, char *path, size_t len)
+{
+	const char *enabled = getenv("HIST_CACHE");
+	if (enabled && atoi(enabled) == 0)
+		return false;
+
+	char dir[PATH_MAX];
+	if (!cache_dir(dir, sizeof(dir)))
+		return false;
+
+	char name[256], driver[256];
+	clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+	clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver), driver, NULL);
+
+	// ločila med polji, da se npr. "ab" + "c" ne ujema z "a" + "bc"
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	hash = fnv1a(hash, name, strlen(name) + 1);
+	hash = fnv1a(hash, driver, strlen(driver) + 1);
+	hash = fnv1a(hash, options, strlen(options) + 1);
+	hash = fnv1a(hash, source, strlen(source));
+
+	// predolga pot bi brala ali pisala drugo datoteko
+	const int n = snprintf(path, len, "%s/%016" PRIx64 ".bin", dir, hash);
+	return n >= 0 && (size_t) n < len;
+}
+
+// program iz predpomnilnika; NULL, če ga ni ali ga gonilnik ne sprejme
+static cl_program load_cached_program(gpu_t *gpu, const char *path, const char *options)
+{
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return NULL;
+
+	// neberljiva ali prazna datoteka šteje kot zgrešitev
+	fseek(fp, 0, SEEK_END);
+	const long end = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	unsigned char *binary = end > 0 ? malloc(end) : NULL;
+	size_t size = binary ? fread(binary, 1, end, fp) : 0;
+	fclose(fp);
+	if (size == 0) {
+		free(binary);
+		return NULL;
+	}
+
+	cl_int status, binary_status;
+	cl_program program = clCreateProgramWithBinary(gpu->context, 1, &gpu->device, &size,
+	                                               (const unsigned char **) &binary, &binary_status, &status);
+	free(binary);
+
+	if (status == CL_SUCCESS && binary_status == CL_SUCCESS)
+		status = clBuildProgram(program, 1, &gpu->device, options, NULL, NULL);
+	if (status != CL_SUCCESS || binary_status != CL_SUCCESS) {
+		if (program)
+			clReleaseProgram(program);
+		return NULL;
+	}
+
+	return program;
+}
+
+// začasna datoteka z enoličnim imenom ob path; po zapisu se preimenuje v path,
+// da sočasni procesi ali niti nikoli ne preberejo napol zapisane datoteke
+static FILE *temp_file(const char *path, char *tmp, size_t len, const char *mode)
+{
+	snprintf(tmp, len, "%s.XXXXXX", path);
+	const int fd = mkstemp(tmp);
+	if (fd < 0)
+		return NULL;
+
+	FILE *fp = fdopen(fd, mode);
+	if (!fp) {
+		close(fd);
+		remove(tmp);
+	}
+	return fp;
+}
+
+// shrani prevedeni program v predpomnilnik
+static void store_program(cl_program program, const char *path)
+{
+	size_t size;
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, NULL) != CL_SUCCESS || size == 0)
+		return;
+
+	unsigned char *binary = malloc(size);
+	clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &binary, NULL);
+
+	char tmp[PATH_MAX + 16];
+	FILE *fp = temp_file(path, tmp, sizeof(tmp), "wb");
+	if (fp) {
+		bool ok = fwrite(binary, 1, size, fp) == size;
+		ok = fclose(fp) == 0 && ok;
+		if (ok)
+			rename(tmp, path);
+		else
+			remove(tmp);
+	}
+	free(binary);
+}
+
+// prebere celotno datoteko v niz, zaključen z ničlo; NULL, če je ni
+static char *read_source(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return NULL;
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	char *source = malloc(size + 1);
+	size_t read = fread(source, 1, size, fp);
+	source[read] = '\0';
+	fclose(fp);
+
+	return source;
+}
+
+// vse naprave na vseh platformah, v vrstnem redu, ki ga izpiše --list-devices
+static int list_devices(cl_device_id *devices, int max)
+{
+	cl_platform_id	platform_id[10];
+	cl_uint			ret_num_platforms = 0;
+	cl_int status = clGetPlatformIDs(10, platform_id, &ret_num_platforms);
+	LOG("ids: %s\n", cl_error(status));
+
+	int n = 0;
+	for (cl_uint p = 0; p < ret_num_platforms && p < 10 && n < max; p++) {
+		cl_uint ret_num_devices = 0;
+		if (clGetDeviceIDs(platform_id[p], CL_DEVICE_TYPE_ALL, max - n, devices + n, &ret_num_devices) == CL_SUCCESS)
+			n += ret_num_devices < (cl_uint) (max - n) ? ret_num_devices : (cl_uint) (max - n);
+	}
+
+	return n;
+}
+
+void print_devices()
+{
+	cl_device_id devices[MAX_DEVICES];
+	const int n = list_devices(devices, MAX_DEVICES);
+
+	for (int d = 0; d < n; d++) {
+		char name[128];
+		cl_device_type type;
+		cl_uint units;
+		clGetDeviceInfo(devices[d], CL_DEVICE_NAME, sizeof(name), name, NULL);
+		clGetDeviceInfo(devices[d], CL_DEVICE_TYPE, sizeof(cl_device_type), &type, NULL);
+		clGetDeviceInfo(devices[d], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &units, NULL);
+		printf("%2d %-4s %3u CU  %s\n", d, type & CL_DEVICE_TYPE_GPU ? "gpu" : type & CL_DEVICE_TYPE_CPU ? "cpu" : "acc", units, name);
+	}
+}
+
+// Izbira naprav: spec je seznam, ločen z vejicami; člen je indeks iz --list-devices,
+// gpu, cpu, all ali podniz imena naprave. Brez spec velja HIST_DEVICE, sicer vse GPE,
+// na sistemu brez GPE pa katera koli naprava.
+static int select_devices(const char *spec, cl_device_id *selected, int max)
+{
+	cl_device_id devices[MAX_DEVICES];
+	const int n = list_devices(devices, MAX_DEVICES);
+	bool use[MAX_DEVICES] = { false };
+
+	const bool fallback = !spec && !getenv("HIST_DEVICE");
+	if (!spec) spec = getenv("HIST_DEVICE");
+	if (!spec) spec = "gpu";
+
+	char *list = strdup(spec), *save;
+	for (char *item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+		char *end;
+		const long index = strtol(item, &end, 10);
+		for (int d = 0; d < n; d++) {
+			char name[128];
+			cl_device_type type;
+			clGetDeviceInfo(devices[d], CL_DEVICE_NAME, sizeof(name), name, NULL);
+			clGetDeviceInfo(devices[d], CL_DEVICE_TYPE, sizeof(cl_device_type), &type, NULL);
+
+			if (end != item && *end == '\0')
+				use[d] |= index == d;
+			else if (strcasecmp(item, "all") == 0)
+				use[d] = true;
+			else if (strcasecmp(item, "gpu") == 0)
+				use[d] |= (type & CL_DEVICE_TYPE_GPU) != 0;
+			else if (strcasecmp(item, "cpu") == 0)
+				use[d] |= (type & CL_DEVICE_TYPE_CPU) != 0;
+			else
+				use[d] |= strstr(name, item) != NULL;
+		}
+	}
+	free(list);
+
+	bool any = false;
+	for (int d = 0; d < n; d++)
+		any |= use[d];
+
+	int count = 0;
+	for (int d = 0; d < n && count < max; d++) {
+		if (use[d] || (fallback && !any))
+			selected[count++] = devices[d];
+	}
+	LOG("devices: %d\n", count);
+
+	return count;
+}
+
+// ključ naprave v datoteki z nastavitvami: ime in različica gonilnika, pri manj
+// koših še njihovo število, saj se najboljša nastavitev z njim spremeni
+static void device_key(const gpu_t *gpu, char *key, size_t len)
+{
+	char name[128], driver[64];
+	clGetDeviceInfo(gpu->device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+	clGetDeviceInfo(gpu->device, CL_DRIVER_VERSION, sizeof(driver), driver, NULL);
+	if (gpu->bins == BINS)
+		snprintf(key, len, "%s (%s)", name, driver);
+	else
+		snprintf(key, len, "%s (%s) bins=%u", name, driver, gpu->bins);
+}
+
+// HIST_TUNE_FILE ali tuning.txt v imeniku predpomnilnika
+static bool tuning_path(char *path, size_t len)
+{
+	const char *env = getenv("HIST_TUNE_FILE");
+	char dir[PATH_MAX];
+	if (!env && !cache_dir(dir, sizeof(dir)))
+		return false;
+
+	// predolga pot bi brala ali pisala drugo datoteko
+	const int n = env ? snprintf(path, len, "%s", env) : snprintf(path, len, "%s/tuning.txt", dir);
+	return n >= 0 && (size_t) n < len;
+}
+
+// Vrstica datoteke z nastavitvami: naprava, razred, kernel, rows, cols, sekund (ločeno s tabulatorji).
+// Vrne razred ali -1, če vrstica ni veljavna; ključ naprave zapiše v dev.
+static int tuning_parse(const char *line, char *dev, size_t dev_len, config_t *cfg)
+{
+	char name[256], kernel[64];
+	int c;
+	if (sscanf(line, "%255[^\t]\t%d\t%63[^\t]\t%u\t%u\t%lf", name, &c, kernel, &cfg->rows, &cfg->cols, &cfg->seconds) != 6)
+		return -1;
+
+	cfg->variant = -1;
+	for (int v = 0; v < KERNELS; v++) {
+		if (strcmp(kernel, kernel_names[v]) == 0)
+			cfg->variant = v;
+	}
+	if (cfg->variant < 0 || cfg->rows == 0 || cfg->cols == 0 || c < 0 || c >= TUNE_CLASSES)
+		return -1;
+
+	snprintf(dev, dev_len, "%s", name);
+	return c;
+}
+
+static void tuning_load(gpu_t *gpu)
+{
+	for (int c = 0; c < TUNE_CLASSES; c++)
+		gpu->tuned[c].variant = -1;
+	gpu->trial = NULL;
+
+	char path[PATH_MAX], key[256], line[512];
+	if (!tuning_path(path, sizeof(path)))
+		return;
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return;
+	device_key(gpu, key, sizeof(key));
+
+	int loaded = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		char dev[256];
+		config_t cfg;
+		const int c = tuning_parse(line, dev, sizeof(dev), &cfg);
+		if (c >= 0 && strcmp(dev, key) == 0 && cfg.rows * cfg.cols <= gpu->max_wg[cfg.variant]) {
+			gpu->tuned[c] = cfg;
+			loaded++;
+		}
+	}
+	fclose(fp);
+	LOG("tuning: %d\n", loaded);
+}
+
+// zapiše nastavitve te naprave; vrstice drugih naprav ostanejo
+void tuning_save(gpu_t *gpu)
+{
+	char path[PATH_MAX], key[256], line[512];
+	if (!tuning_path(path, sizeof(path)))
+		return;
+	device_key(gpu, key, sizeof(key));
+
+	char tmp[PATH_MAX + 16];
+	FILE *out = temp_file(path, tmp, sizeof(tmp), "w");
+	if (!out) {
+		fprintf(stderr, "cannot write %s\n", path);
+		return;
+	}
+
+	FILE *fp = fopen(path, "r");
+	while (fp && fgets(line, sizeof(line), fp)) {
+		char dev[256];
+		config_t cfg;
+		if (tuning_parse(line, dev, sizeof(dev), &cfg) >= 0 && strcmp(dev, key) != 0)
+			fputs(line, out);
+	}
+	if (fp)
+		fclose(fp);
+
+	for (int c = 0; c < TUNE_CLASSES; c++) {
+		const config_t *cfg = &gpu->tuned[c];
+		if (cfg->variant >= 0)
+			fprintf(out, "%s\t%d\t%s\t%u\t%u\t%.9lf\n", key, c, kernel_names[cfg->variant], cfg->rows, cfg->cols, cfg->seconds);
+	}
+
+	if (fclose(out) == 0)
+		rename(tmp, path);
+	else
+		remove(tmp);
+}
+
+// velikost pasu in število pasov v obroču iz okolja
+static size_t strip_bytes()
+{
+	const char *mb = getenv("HIST_STRIP_MB");
+	return mb && atoi(mb) > 0 ? (size_t) atoi(mb) << 20 : TILE_STRIP_BYTES;
+}
+
+static uint32_t strip_count()
+{
+	const char *n = getenv("HIST_STRIPS");
+	return n && atoi(n) > 0 ? (uint32_t) min(atoi(n), TILE_MAX_STRIPS) : TILE_STRIPS;
+}
+
+// vrne CL_SUCCESS ali napako; ob napaki ne ostane nič, kar bi bilo treba sprostiti
+static cl_int cl_init_device(gpu_t *gpu, cl_device_id device, uint32_t bins)
+{
+	cl_int status;
+    struct timespec start, finish;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// Izvorna koda ščepcev je vgrajena v program (histogram_cl.h generira Makefile);
+	// HIST_KERNEL_DIR jo nadomesti z datoteko histogram.cl iz danega imenika
+	char *source_str;
+	const char *kernel_dir = getenv("HIST_KERNEL_DIR");
+	if (kernel_dir) {
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "%s/histogram.cl", kernel_dir);
+		source_str = read_source(path);
+		if (!source_str) {
+			fprintf(stderr, "cannot open kernel file %s\n", path);
+			return CL_INVALID_VALUE;
+		}
+	}
+	else
+		source_str = strdup(histogram_cl);
+
+	// Podatki o napravi
+	cl_device_id	device_id[1] = { device };
+	char			device_name[128];
+	clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
+	LOG("device: %s\n", device_name);
+
+	gpu->device = device;
+	gpu->bins = bins;
+	gpu->rate_cpu = gpu->rate_gpu = 0;
+	gpu->hybrid_share = HYBRID_INITIAL;
+	gpu->img_mem_obj = NULL;
+	gpu->img_capacity = 0;
+
+	// Brez kopiranja, če si naprava deli pomnilnik z gostiteljem (CPE, integrirana GPE);
+	// HIST_ZERO_COPY=0/1 izbiro povozi
+	cl_bool unified = CL_FALSE;
+	cl_uint align_bits = 0;
+	clGetDeviceInfo(gpu->device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified, NULL);
+	clGetDeviceInfo(gpu->device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &align_bits, NULL);
+	const char *env = getenv("HIST_ZERO_COPY");
+	gpu->zero_copy = env ? atoi(env) != 0 : unified == CL_TRUE;
+	gpu->img_align = max(4096, align_bits / 8);
+	gpu->base_align = max(4, align_bits / 8);
+	LOG("zero copy: %s\n", gpu->zero_copy ? "yes" : "no");
+
+	// Kontekst
+	gpu->context = clCreateContext(NULL, 1, &device_id[0], NULL, NULL, &status);
+	if (!gpu->context) {
+		free(source_str);
+		return status;
+	}
+
+	// Ukazna vrsta; HIST_PROFILE=1 vklopi merjenje faz z dogodki
+	const char *profile = getenv("HIST_PROFILE");
+	gpu->profiling = profile && atoi(profile) != 0;
+	memset(&gpu->profile, 0, sizeof(profile_t));
+	gpu->profile_csv = NULL;
+	gpu->command_queue = clCreateCommandQueue(gpu->context, device_id[0],
+	                                          gpu->profiling ? CL_QUEUE_PROFILING_ENABLE : 0, NULL);
+
+	// Kerneli se prevedejo za število košev; BIN_SHIFT je log2(BINS / bins)
+	char options[64];
+	uint32_t shift = 0;
+	while ((BINS >> shift) > bins)
+		shift++;
+	snprintf(options, sizeof(options), BUILD_OPTIONS, bins, shift);
+
+	// Prevedeni program iz predpomnilnika, če obstaja
+	char cache[PATH_MAX];
+	const bool cached = cache_path(gpu->device, source_str, options, cache, sizeof(cache));
+	gpu->program = cached ? load_cached_program(gpu, cache, options) : NULL;
+	LOG("cache: %s\n", gpu->program ? "hit" : cached ? "miss" : "off");
+
+	if (!gpu->program) {
+		// Priprava programa
+		gpu->program = clCreateProgramWithSource(gpu->context, 1, (const char **) &source_str, NULL, NULL);
+
+		// Prevajanje
+		status = clBuildProgram(gpu->program, 1, device_id, options, NULL, NULL);
+		LOG("build: %s\n", cl_error(status));
+
+		if (status == CL_SUCCESS && cached)
+			store_program(gpu->program, cache);
+
+		if (status != 0) {
+			// Log
+			size_t build_log_len;
+			char *build_log;
+			status = clGetProgramBuildInfo(gpu->program, device_id[0], CL_PROGRAM_BUILD_LOG, 0, NULL, &build_log_len);
+
+			build_log = (char *) malloc(build_log_len + 1);
+			clGetProgramBuildInfo(gpu->program, device_id[0], CL_PROGRAM_BUILD_LOG, build_log_len, build_log, NULL);
+			fprintf(stderr, "%s\n", build_log);
+			free(build_log);
+
+			clReleaseProgram(gpu->program);
+			clReleaseCommandQueue(gpu->command_queue);
+			clReleaseContext(gpu->context);
+			free(source_str);
+			return CL_BUILD_PROGRAM_FAILURE;
+		}
+	}
+
+	// kernel: priprava objektov za vse različice
+	for (int v = 0; v < KERNELS; v++) {
+		gpu->kernels[v] = clCreateKernel(gpu->program, kernel_names[v], NULL);
+		clGetKernelWorkGroupInfo(gpu->kernels[v], gpu->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &gpu->max_wg[v], NULL);
+	}
+	gpu->coarsening = 1;
+
+	// HIST_KERNEL izbere različico po imenu, sicer osnovni kernel
+	gpu->variant = KERNEL_BASIC;
+	const char *variant = getenv("HIST_KERNEL");
+	for (int v = 0; variant && v < KERNELS; v++) {
+		if (strcmp(variant, kernel_names[v]) == 0)
+			gpu->variant = v;
+	}
+	clGetDeviceInfo(gpu->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &gpu->compute_units, NULL);
+	clGetDeviceInfo(gpu->device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &gpu->local_mem, NULL);
+
+	// Kopije zasedejo največ polovico lokalnega pomnilnika, ki ga kernel in
+	// izvedba še ne porabita, da sta na računski enoti hkrati vsaj dve skupini;
+	// največja potenca 2 v tej meji (z manj koši več kopij). HIST_COPIES jo
+	// povozi, dokler kopije sploh gredo v prosti lokalni pomnilnik.
+	const size_t copy_bytes = 3 * bins * sizeof(cl_uint);
+	cl_ulong kernel_local = 0;
+	clGetKernelWorkGroupInfo(gpu->kernels[KERNEL_REPL], gpu->device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(cl_ulong),
+	                         &kernel_local, NULL);
+	const cl_ulong local_free = gpu->local_mem > kernel_local ? gpu->local_mem - kernel_local : 0;
+	gpu->copies = 1;
+	while (gpu->copies * 2 <= MAX_COPIES && gpu->copies * 2 * copy_bytes <= local_free / 2)
+		gpu->copies *= 2;
+	const char *copies = getenv("HIST_COPIES");
+	if (copies && atoi(copies) > 0 && atoi(copies) * copy_bytes <= local_free)
+		gpu->copies = atoi(copies);
+	LOG("local copies: %u\n", gpu->copies);
+
+	// dvofazno seštevanje delnih histogramov; HIST_REDUCE=atomic|two-phase izbiro povozi
+	gpu->reduce_kernel = clCreateKernel(gpu->program, "reduce_histogram", NULL);
+	gpu->rgb_kernel = clCreateKernel(gpu->program, "calc_histogram_rgb", NULL);
+	clGetKernelWorkGroupInfo(gpu->rgb_kernel, gpu->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &gpu->rgb_max_wg, NULL);
+	gpu->packed = false;
+	gpu->rects_kernel = clCreateKernel(gpu->program, "calc_histogram_rects", NULL);
+	clGetKernelWorkGroupInfo(gpu->rects_kernel, gpu->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &gpu->rects_max_wg, NULL);
+	gpu->rects_mem_obj = gpu->tiles_mem_obj = NULL;
+	gpu->rects_capacity = gpu->tiles_capacity = 0;
+	gpu->lut_kernel = clCreateKernel(gpu->program, "calc_lut", NULL);
+	clGetKernelWorkGroupInfo(gpu->lut_kernel, gpu->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &gpu->lut_max_wg, NULL);
+	gpu->apply_kernel = clCreateKernel(gpu->program, "apply_lut", NULL);
+	clGetKernelWorkGroupInfo(gpu->apply_kernel, gpu->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &gpu->apply_max_wg, NULL);
+	gpu->lut_mem_obj = gpu->eq_mem_obj = NULL;
+	gpu->lut_capacity = gpu->eq_capacity = 0;
+	gpu->clip_kernel = clCreateKernel(gpu->program, "clip_lut", NULL);
+	clGetKernelWorkGroupInfo(gpu->clip_kernel, gpu->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &gpu->clip_max_wg, NULL);
+	gpu->clahe_kernel = clCreateKernel(gpu->program, "apply_clahe", NULL);
+	clGetKernelWorkGroupInfo(gpu->clahe_kernel, gpu->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &gpu->clahe_max_wg, NULL);
+	gpu->partial_mem_obj[0] = gpu->partial_mem_obj[1] = NULL;
+	gpu->partial_capacity[0] = gpu->partial_capacity[1] = 0;
+	gpu->two_phase = false;
+	const char *reduce = getenv("HIST_REDUCE");
+	gpu->reduce = !reduce ? REDUCE_AUTO :
+		strcmp(reduce, "atomic") == 0 ? REDUCE_ATOMIC :
+		strcmp(reduce, "two-phase") == 0 ? REDUCE_TWO_PHASE : REDUCE_AUTO;
+
+	// pretakanje po pasovih; HIST_TILED=0/1 ga izklopi oz. vsili, HIST_STRIP_MB in
+	// HIST_STRIPS omejita pomnilnik
+	clGetDeviceInfo(gpu->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &gpu->max_alloc, NULL);
+	const char *tiled = getenv("HIST_TILED");
+	gpu->tiled = !tiled ? TILED_AUTO : atoi(tiled) != 0 ? TILED_ON : TILED_OFF;
+	gpu->strip_bytes = strip_bytes();
+	gpu->strips = strip_count();
+	for (int k = 0; k < TILE_MAX_STRIPS; k++) {
+		gpu->strip_mem_obj[k] = NULL;
+		gpu->strip_capacity[k] = 0;
+	}
+	gpu->upload_queue = NULL;
+	gpu->accumulate = false;
+	gpu->pitch = 0;
+
+	// kerneli histogram tudi berejo (atomarno prištevanje, pasovi)
+	gpu->hist_mem_obj = clCreateBuffer(gpu->context, CL_MEM_READ_WRITE, sizeof(histogram_t), NULL, &status);
+	LOG("make buffer: %s\n", cl_error(status));
+
+	free(source_str);
+
+	tuning_load(gpu);
+
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+	LOG("init: %lf s\n", (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1000000000.0);
+
+	return CL_SUCCESS;
+}
+
+// inicializira vse izbrane naprave (največ max) in vrne njihovo število ali napako
+// (< 0): CL_DEVICE_NOT_FOUND, če spec ne izbere nobene, sicer napako prve naprave,
+// ki se ni dala pripraviti; datoteko CSV za HIST_PROFILE ima le prva naprava
+int cl_init_devices(gpu_t *gpus, int max, const char *spec)
+{
+	return cl_init_devices_bins(gpus, max, spec, BINS);
+}
+
+// kot cl_init_devices, kerneli pa štejejo bins košev na kanal (valid_bins)
+int cl_init_devices_bins(gpu_t *gpus, int max, const char *spec, uint32_t bins)
+{
+	if (!valid_bins(bins))
+		return CL_INVALID_VALUE;
+
+	cl_device_id devices[MAX_DEVICES];
+	const int n = select_devices(spec, devices, max < MAX_DEVICES ? max : MAX_DEVICES);
+	if (n == 0) {
+		fprintf(stderr, "no OpenCL device matches '%s'\n", spec ? spec : getenv("HIST_DEVICE") ? getenv("HIST_DEVICE") : "gpu");
+		return CL_DEVICE_NOT_FOUND;
+	}
+
+	for (int d = 0; d < n; d++) {
+		const cl_int status = cl_init_device(&gpus[d], devices[d], bins);
+		if (status != CL_SUCCESS) {
+			while (d-- > 0)
+				cl_finalize(&gpus[d]);
+			return status;
+		}
+	}
+
+	if (gpus[0].profiling) {
+		const char *csv = getenv("HIST_PROFILE_CSV");
+		gpus[0].profile_csv = fopen(csv ? csv : "profile.csv", "w");
+		if (gpus[0].profile_csv)
+			fprintf(gpus[0].profile_csv, "label,phase,samples,min_s,median_s,p99_s,bytes_per_s,pixels_per_s\n");
+	}
+
+	return n;
+}
+
+int cl_init(gpu_t *gpu)
+{
+	const int n = cl_init_devices(gpu, 1, NULL);
+	return n < 0 ? n : CL_SUCCESS;
+}
+
+void cl_finalize(gpu_t *gpu)
+{
+	if (gpu->img_mem_obj)
+		clReleaseMemObject(gpu->img_mem_obj);
+	for (int k = 0; k < TILE_MAX_STRIPS; k++) {
+		if (gpu->strip_mem_obj[k])
+			clReleaseMemObject(gpu->strip_mem_obj[k]);
+	}
+	if (gpu->upload_queue)
+		clReleaseCommandQueue(gpu->upload_queue);
+	for (int i = 0; i < 2; i++) {
+		if (gpu->partial_mem_obj[i])
+			clReleaseMemObject(gpu->partial_mem_obj[i]);
+	}
+	if (gpu->rects_mem_obj)
+		clReleaseMemObject(gpu->rects_mem_obj);
+	if (gpu->tiles_mem_obj)
+		clReleaseMemObject(gpu->tiles_mem_obj);
+	clReleaseKernel(gpu->reduce_kernel);
+	clReleaseKernel(gpu->rgb_kernel);
+	clReleaseKernel(gpu->rects_kernel);
+	if (gpu->lut_mem_obj)
+		clReleaseMemObject(gpu->lut_mem_obj);
+	if (gpu->eq_mem_obj)
+		clReleaseMemObject(gpu->eq_mem_obj);
+	clReleaseKernel(gpu->lut_kernel);
+	clReleaseKernel(gpu->apply_kernel);
+	clReleaseKernel(gpu->clip_kernel);
+	clReleaseKernel(gpu->clahe_kernel);
+	for (int p = 0; p < PHASES; p++)
+		free(gpu->profile.t[p]);
+	if (gpu->profile_csv)
+		fclose(gpu->profile_csv);
+	clReleaseMemObject(gpu->hist_mem_obj);
+	for (int v = 0; v < KERNELS; v++)
+		clReleaseKernel(gpu->kernels[v]);
+	clReleaseProgram(gpu->program);
+	clReleaseCommandQueue(gpu->command_queue);
+	clReleaseContext(gpu->context);
+}
+
+void histogramCPU(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	memset(H, 0, sizeof(histogram_t));
+    // Each color channel is 1 byte long, there are 4 channels BLUE, GREEN, RED and ALPHA
+    // The order is BLUE|GREEN|RED|ALPHA for each pixel, we ignore the ALPHA channel when computing the histograms
+	for (int i = 0; i < height; i++) {
+		for (int j = 0; j < width; j++)
+		{
+			H->R[image[(i * width + j) * 4 + 2]]++;
+			H->G[image[(i * width + j) * 4 + 1]]++;
+			H->B[image[(i * width + j) * 4 + 0]]++;
+		}
+	}
+}
+
+// isto za stisnjene piksle BGR (3 bajti na piksel)
+void histogramCPU_rgb(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	memset(H, 0, sizeof(histogram_t));
+	const size_t n = (size_t) width * height;
+	for (size_t p = 0; p < n; p++) {
+		H->R[image[3 * p + 2]]++;
+		H->G[image[3 * p + 1]]++;
+		H->B[image[3 * p + 0]]++;
+	}
+}
+
+// Število kopij števcev: sosednji piksli s isto vrednostjo povečujejo različne
+// naslove, zato se zaporedni inkrementi ne čakajo prek store-to-load forwardinga
+#define COPIES 4
+
+
+// prišteje števce vseh kopij v H
+static void merge_copies(histogram_t *H, uint32_t cnt[COPIES][3][256])
+{
+	for (int i = 0; i < BINS; i++) {
+		for (int c = 0; c < COPIES; c++) {
+			H->R[i] += cnt[c][0][i];
+			H->G[i] += cnt[c][1][i];
+			H->B[i] += cnt[c][2][i];
+		}
+	}
+}
+
+// n pikslov z bpp bajti (BGRA ali BGR) v števce; piksel k gre v kopijo k % COPIES
+static inline void count_row(uint32_t cnt[COPIES][3][256], const uint8_t *pixels, size_t n, size_t bpp)
+{
+	size_t k = 0;
+	for (; k + COPIES <= n; k += COPIES) {
+		for (int c = 0; c < COPIES; c++) {
+			const uint8_t *p = pixels + (k + c) * bpp;
+			cnt[c][0][p[2]]++;
+			cnt[c][1][p[1]]++;
+			cnt[c][2][p[0]]++;
+		}
+	}
+	for (; k < n; k++) {
+		const uint8_t *p = pixels + k * bpp;
+		cnt[0][0][p[2]]++;
+		cnt[0][1][p[1]]++;
+		cnt[0][2][p[0]]++;
+	}
+}
+
+// Jedra pixels_fn preštejejo rows vrstic po width pikslov, ki se začnejo pitch
+// bajtov narazen, in prištejejo v H. Strnjeno sliko klicatelj poda kot eno vrstico
+// (count_pixels), da se kratke vrstice ne delijo na ostanke.
+
+// stisnjeni piksli BGR s kopijami števcev kot histogram_pixels_scalar
+static void histogram_pixels_rgb(histogram_t *H, const uint8_t *pixels, size_t width, size_t rows, size_t pitch)
+{
+	uint32_t cnt[COPIES][3][256] = { 0 };
+
+	for (size_t r = 0; r < rows; r++)
+		count_row(cnt, pixels + r * pitch, width, 3);
+
+	merge_copies(H, cnt);
+}
+
+static void histogram_pixels_scalar(histogram_t *H, const uint8_t *pixels, size_t width, size_t rows, size_t pitch)
+{
+	uint32_t cnt[COPIES][3][256] = { 0 };
+
+	for (size_t r = 0; r < rows; r++)
+		count_row(cnt, pixels + r * pitch, width, 4);
+
+	merge_copies(H, cnt);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// 4 piksli iz ravnin: b, g in r vsebujejo po en kanal v zaporednih bajtih,
+// piksel c gre v kopijo c
+static inline void count4_planes(uint32_t cnt[COPIES][3][256], uint32_t b, uint32_t g, uint32_t r)
+{
+	cnt[0][0][r & 0xFF]++;         cnt[0][1][g & 0xFF]++;         cnt[0][2][b & 0xFF]++;
+	cnt[1][0][(r >> 8) & 0xFF]++;  cnt[1][1][(g >> 8) & 0xFF]++;  cnt[1][2][(b >> 8) & 0xFF]++;
+	cnt[2][0][(r >> 16) & 0xFF]++; cnt[2][1][(g >> 16) & 0xFF]++; cnt[2][2][(b >> 16) & 0xFF]++;
+	cnt[3][0][r >> 24]++;          cnt[3][1][g >> 24]++;          cnt[3][2][b >> 24]++;
+}
+
+// Razpakiranje 4 pikslov BGRA v ravnine v registru: maske in zamiki izločijo
+// kanale iz 32-bitnih besed, pakiranje jih stisne v [B0..B3 G0..G3 R0..R3 0..0].
+__attribute__((target("sse2")))
+static inline __m128i planes4_sse2(__m128i p)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i b = _mm_and_si128(p, mask);
+	const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+	const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), mask);
+	return _mm_packus_epi16(_mm_packs_epi32(b, g), _mm_packs_epi32(r, _mm_setzero_si128()));
+}
+
+__attribute__((target("sse2")))
+static void histogram_pixels_sse2(histogram_t *H, const uint8_t *pixels, size_t width, size_t rows, size_t pitch)
+{
+	uint32_t cnt[COPIES][3][256] = { 0 };
+
+	for (size_t r = 0; r < rows; r++) {
+		const uint8_t *row = pixels + r * pitch;
+		size_t k = 0;
+		for (; k + 4 <= width; k += 4) {
+			const __m128i v = planes4_sse2(_mm_loadu_si128((const __m128i *) (row + k * 4)));
+			count4_planes(cnt, _mm_cvtsi128_si32(v), _mm_cvtsi128_si32(_mm_srli_si128(v, 4)),
+			              _mm_cvtsi128_si32(_mm_srli_si128(v, 8)));
+		}
+		count_row(cnt, row + k * 4, width - k, 4);
+	}
+
+	merge_copies(H, cnt);
+}
+
+// Razpakiranje 8 pikslov BGRA: pshufb v vsaki 128-bitni polovici zbere kanale
+// v [B G R A] po 4 bajte, permutacija 32-bitnih besed pa združi polovici v
+// [B0..B7 G0..G7 R0..R7 A0..A7].
+__attribute__((target("avx2")))
+static inline __m256i planes8_avx2(__m256i p)
+{
+	const __m256i shuf = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+	                                      0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	const __m256i t = _mm256_shuffle_epi8(p, shuf);
+	return _mm256_permutevar8x32_epi32(t, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+__attribute__((target("avx2")))
+static void histogram_pixels_avx2(histogram_t *H, const uint8_t *pixels, size_t width, size_t rows, size_t pitch)
+{
+	uint32_t cnt[COPIES][3][256] = { 0 };
+
+	for (size_t r = 0; r < rows; r++) {
+		const uint8_t *row = pixels + r * pitch;
+		size_t k = 0;
+		for (; k + 8 <= width; k += 8) {
+			const __m256i v = planes8_avx2(_mm256_loadu_si256((const __m256i *) (row + k * 4)));
+			const __m128i bg = _mm256_castsi256_si128(v), ra = _mm256_extracti128_si256(v, 1);
+			count4_planes(cnt, _mm_cvtsi128_si32(bg), _mm_extract_epi32(bg, 2), _mm_cvtsi128_si32(ra));
+			count4_planes(cnt, _mm_extract_epi32(bg, 1), _mm_extract_epi32(bg, 3), _mm_extract_epi32(ra, 1));
+		}
+		count_row(cnt, row + k * 4, width - k, 4);
+	}
+
+	merge_copies(H, cnt);
+}
+#endif
+
+const char *simd_names[] = { "scalar", "sse2", "avx2" };
+const pixels_fn simd_fns[] = {
+	histogram_pixels_scalar,
+#if defined(__x86_64__) || defined(__i386__)
+	histogram_pixels_sse2,
+	histogram_pixels_avx2,
+#endif
+};
+
+int simd_level;
+pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+
+void simd_detect()
+{
+	simd_level = 0;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) simd_level = 1;
+	if (__builtin_cpu_supports("avx2")) simd_level = 2;
+#endif
+
+	// HIST_SIMD lahko izbiro samo zniža (scalar, sse2, avx2)
+	const char *env = getenv("HIST_SIMD");
+	for (int l = 0; env && l < simd_level; l++) {
+		if (strcmp(env, simd_names[l]) == 0)
+			simd_level = l;
+	}
+}
+
+// najboljše jedro, ki ga podpira procesor
+static pixels_fn histogram_pixels()
+{
+	pthread_once(&simd_once, simd_detect);
+	return simd_fns[simd_level];
+}
+
+// strnjene vrstice (pitch == width * bpp) se štejejo kot ena dolga vrstica
+static void count_pixels(pixels_fn count, histogram_t *H, const uint8_t *pixels, size_t width, size_t rows,
+                         size_t pitch, size_t bpp)
+{
+	if (pitch == width * bpp)
+		count(H, pixels, width * rows, 1, pitch * rows);
+	else
+		count(H, pixels, width, rows, pitch);
+}
+
+void histogramSIMD(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	memset(H, 0, sizeof(histogram_t));
+	count_pixels(histogram_pixels(), H, image, width, height, (size_t) width * 4, 4);
+}
+
+uint32_t cpu_threads()
+{
+	// HIST_THREADS povozi število jeder
+	const char *env = getenv("HIST_THREADS");
+	if (env && atoi(env) > 0)
+		return atoi(env);
+
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+}
+
+static void *histogram_band(void *arg)
+{
+	band_t *band = arg;
+
+	// zasebni histogram na skladu niti, da si niti ne delijo predpomnilniških vrstic
+	histogram_t H = { 0 };
+	count_pixels(band->count, &H, band->image + band->row_begin * band->pitch, band->width,
+	             band->row_end - band->row_begin, band->pitch, band->bpp);
+	band->H = H;
+
+	return NULL;
+}
+
+static void histogram_bands(histogram_t *H, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch,
+                            uint32_t threads, uint32_t bpp, pixels_fn count)
+{
+	if (threads == 0) threads = cpu_threads();
+	if (threads > height) threads = height > 0 ? height : 1;
+
+	band_t *bands = malloc(threads * sizeof(band_t));
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+
+	// Delitev dela: vsaka nit dobi pas zaporednih vrstic
+	for (uint32_t t = 0; t < threads; t++) {
+		bands[t].image = image;
+		bands[t].width = width;
+		bands[t].bpp = bpp;
+		bands[t].pitch = pitch;
+		bands[t].count = count;
+		bands[t].row_begin = (uint64_t) height * t / threads;
+		bands[t].row_end   = (uint64_t) height * (t + 1) / threads;
+	}
+
+	// glavna nit obdela prvi pas sama
+	for (uint32_t t = 1; t < threads; t++)
+		pthread_create(&tids[t], NULL, histogram_band, &bands[t]);
+	histogram_band(&bands[0]);
+
+	// združevanje zasebnih histogramov
+	*H = bands[0].H;
+	for (uint32_t t = 1; t < threads; t++) {
+		pthread_join(tids[t], NULL);
+		for (int i = 0; i < BINS; i++) {
+			H->R[i] += bands[t].H.R[i];
+			H->G[i] += bands[t].H.G[i];
+			H->B[i] += bands[t].H.B[i];
+		}
+	}
+
+	free(tids);
+	free(bands);
+}
+
+void histogramCPU_MT(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t threads)
+{
+	histogram_bands(H, image, width, height, (size_t) width * 4, threads, 4, histogram_pixels());
+}
+
+// stisnjeni piksli BGR na vseh jedrih
+void histogramCPU_MT_rgb(histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t threads)
+{
+	histogram_bands(H, image, width, height, (size_t) width * 3, threads, 3, histogram_pixels_rgb);
+}
+
+// Histogram dela slike brez kopiranja: vrstice po width pikslov z bpp bajti se
+// začnejo pitch bajtov narazen. threads == 1 šteje v klicni niti; scalar izbere
+// skalarno jedro namesto najboljšega SIMD (BGR ima le skalarnega).
+void histogramCPU_pitch(histogram_t *H, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch,
+                        uint32_t bpp, uint32_t threads, bool scalar)
+{
+	const pixels_fn count = bpp == 3 ? histogram_pixels_rgb : scalar ? histogram_pixels_scalar : histogram_pixels();
+	histogram_bands(H, image, width, height, pitch, threads, bpp, count);
+}
+
+// število košev na kanal, ki ga zmorejo kerneli: potenca 2 od 1 do BINS
+bool valid_bins(uint32_t bins)
+{
+	return bins >= 1 && bins <= BINS && (bins & (bins - 1)) == 0;
+}
+
+// n histogramov z BINS koši stisne v bins košev, kot jih šteje naprava: koš b
+// dobi vrednosti [b * BINS / bins, (b + 1) * BINS / bins), ostali koši so 0
+void fold_bins(histogram_t *H, size_t n, uint32_t bins)
+{
+	const uint32_t width = BINS / bins;
+	if (width == 1)
+		return;
+
+	for (size_t h = 0; h < n; h++) {
+		uint32_t *hist[3] = { H[h].R, H[h].G, H[h].B };
+		for (int c = 0; c < 3; c++) {
+			for (uint32_t b = 0; b < bins; b++) {
+				uint32_t sum = 0;
+				for (uint32_t i = b * width; i < (b + 1) * width; i++)
+					sum += hist[c][i];
+				hist[c][b] = sum;
+			}
+			memset(hist[c] + bins, 0, (BINS - bins) * sizeof(uint32_t));
+		}
+	}
+}
+
+// izrezi [first, n) s korakom step, ki jih obdela ena nit
+typedef struct
+{
+	histogram_t *H;
+	const uint8_t *image;
+	size_t pitch;
+	uint32_t bpp;
+	const hist_rect_t *rects;
+	uint32_t n, first, step;
+	pixels_fn count;
+}
+rects_job_t;
+
+static void *histogram_rects_job(void *arg)
+{
+	rects_job_t *job = arg;
+
+	for (uint32_t r = job->first; r < job->n; r += job->step) {
+		const hist_rect_t *rect = &job->rects[r];
+		memset(&job->H[r], 0, sizeof(histogram_t));
+		count_pixels(job->count, &job->H[r], job->image + rect->y * job->pitch + (size_t) rect->x * job->bpp,
+		             rect->width, rect->height, job->pitch, job->bpp);
+	}
+
+	return NULL;
+}
+
+// Histogrami izrezov, ki morajo biti znotraj slike; vsak piksel izreza se prebere
+// enkrat. Pri vsaj toliko izrezih kot nitih vsaka nit vzame vsak threads-ti izrez,
+// sicer se vsak izrez razdeli na pasove vrstic kot v histogramCPU_pitch.
+void histogramCPU_rects(histogram_t *H, const uint8_t *image, size_t pitch, uint32_t bpp,
+                        const hist_rect_t *rects, uint32_t n, uint32_t threads, bool scalar)
+{
+	if (threads == 0) threads = cpu_threads();
+
+	if (n < threads) {
+		for (uint32_t r = 0; r < n; r++)
+			histogramCPU_pitch(&H[r], image + rects[r].y * pitch + (size_t) rects[r].x * bpp,
+			                   rects[r].width, rects[r].height, pitch, bpp, threads, scalar);
+		return;
+	}
+
+	const pixels_fn count = bpp == 3 ? histogram_pixels_rgb : scalar ? histogram_pixels_scalar : histogram_pixels();
+	rects_job_t *jobs = malloc(threads * sizeof(rects_job_t));
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+
+	for (uint32_t t = 0; t < threads; t++)
+		jobs[t] = (rects_job_t) { H, image, pitch, bpp, rects, n, t, threads, count };
+
+	for (uint32_t t = 1; t < threads; t++)
+		pthread_create(&tids[t], NULL, histogram_rects_job, &jobs[t]);
+	histogram_rects_job(&jobs[0]);
+	for (uint32_t t = 1; t < threads; t++)
+		pthread_join(tids[t], NULL);
+
+	free(tids);
+	free(jobs);
+}
+
+// LUT izenačenja kot kernel calc_lut: koš i se preslika v
+// round((cdf[i] - cdf_min) * 255 / (n - cdf_min)), cdf_min je CDF prvega nepraznega koša
+void equalize_lut(const histogram_t *H, uint8_t lut[3][BINS])
+{
+	const uint32_t *hist[3] = { H->R, H->G, H->B };
+
+	for (int c = 0; c < 3; c++) {
+		uint32_t cdf[BINS], sum = 0, cdf_min = 0;
+		for (int i = 0; i < BINS; i++) {
+			sum += hist[c][i];
+			cdf[i] = sum;
+			if (cdf_min == 0)
+				cdf_min = sum;
+		}
+
+		// enobarven kanal ostane nespremenjen
+		const uint64_t range = sum - cdf_min;
+		for (int i = 0; i < BINS; i++)
+			lut[c][i] = range == 0 ? i : ((uint64_t) (max(cdf[i], cdf_min) - cdf_min) * 255 + range / 2) / range;
+	}
+}
+
+// pas vrstic [row_begin, row_end), ki ga ena nit preslika skozi LUT
+typedef struct
+{
+	uint8_t *out;
+	const uint8_t *image;
+	uint32_t width, row_begin, row_end;
+	size_t pitch;
+	uint32_t bpp;
+	const uint8_t (*lut)[BINS];
+}
+apply_band_t;
+
+static void *apply_band(void *arg)
+{
+	apply_band_t *band = arg;
+	const uint8_t *R = band->lut[0], *G = band->lut[1], *B = band->lut[2];
+	const uint32_t bpp = band->bpp;
+
+	for (uint32_t y = band->row_begin; y < band->row_end; y++) {
+		const uint8_t *in = band->image + y * band->pitch;
+		uint8_t *out = band->out + (size_t) y * band->width * bpp;
+		for (uint32_t x = 0; x < band->width; x++, in += bpp, out += bpp) {
+			out[0] = B[in[0]];
+			out[1] = G[in[1]];
+			out[2] = R[in[2]];
+			if (bpp == 4)
+				out[3] = in[3];
+		}
+	}
+
+	return NULL;
+}
+
+// Izenačenje histograma na CPE: histogram kot histogramCPU_pitch, LUT na gostitelju,
+// preslikava po pasovih vrstic na threads nitih. out nima razmika med vrsticami.
+void equalizeCPU(uint8_t *out, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch, uint32_t bpp,
+                 uint32_t threads, bool scalar)
+{
+	histogram_t H;
+	uint8_t lut[3][BINS];
+	histogramCPU_pitch(&H, image, width, height, pitch, bpp, threads, scalar);
+	equalize_lut(&H, lut);
+
+	if (threads == 0) threads = cpu_threads();
+	if (threads > height) threads = height > 0 ? height : 1;
+
+	apply_band_t *bands = malloc(threads * sizeof(apply_band_t));
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+
+	for (uint32_t t = 0; t < threads; t++) {
+		bands[t] = (apply_band_t) { out, image, width, (uint64_t) height * t / threads,
+		                            (uint64_t) height * (t + 1) / threads, pitch, bpp, (const uint8_t (*)[BINS]) lut };
+	}
+
+	for (uint32_t t = 1; t < threads; t++)
+		pthread_create(&tids[t], NULL, apply_band, &bands[t]);
+	apply_band(&bands[0]);
+	for (uint32_t t = 1; t < threads; t++)
+		pthread_join(tids[t], NULL);
+
+	free(tids);
+	free(bands);
+}
+
+// mreža tiles_x x tiles_y ploščic slike, po vrsticah ploščic
+void grid_rects(hist_rect_t *tiles, uint32_t width, uint32_t height, uint32_t tiles_x, uint32_t tiles_y)
+{
+	for (uint32_t ty = 0; ty < tiles_y; ty++) {
+		for (uint32_t tx = 0; tx < tiles_x; tx++) {
+			const uint32_t x0 = (uint64_t) width * tx / tiles_x, x1 = (uint64_t) width * (tx + 1) / tiles_x;
+			const uint32_t y0 = (uint64_t) height * ty / tiles_y, y1 = (uint64_t) height * (ty + 1) / tiles_y;
+			tiles[(size_t) ty * tiles_x + tx] = (hist_rect_t) { x0, y0, x1 - x0, y1 - y0 };
+		}
+	}
+}
+
+// meja rezanja v 1/256 povprečnega koša, kot jo pričakuje clip_lut; 0 = brez rezanja
+uint32_t clahe_clip(float clip_limit)
+{
+	// od BINS-kratnika naprej je meja vsaj ploščina ploščice
+	if (!(clip_limit > 0) || clip_limit >= BINS)
+		return 0;
+	return max(1, (uint32_t) (clip_limit * 256 + 0.5f));
+}
+
+// LUT ploščice s ploščino area kot kernel clip_lut
+void clahe_lut(const histogram_t *H, uint32_t area, uint32_t clip, uint8_t lut[3][BINS])
+{
+	const uint32_t *hist[3] = { H->R, H->G, H->B };
+	const uint32_t limit = clip == 0 ? area : max(1, ((uint64_t) area * clip) >> 16);
+
+	for (int c = 0; c < 3; c++) {
+		uint32_t excess = 0, sum = 0;
+		for (int i = 0; i < BINS; i++)
+			excess += hist[c][i] > limit ? hist[c][i] - limit : 0;
+
+		for (int i = 0; i < BINS; i++) {
+			sum += min(hist[c][i], limit) + excess / BINS + (i < excess % BINS);
+			lut[c][i] = area == 0 ? i : ((uint64_t) sum * 255 + area / 2) / area;
+		}
+	}
+}
+
+// sosednji ploščici in utež druge (0..256) za koordinato x kot clahe_axis v kernelu
+static inline void clahe_axis(uint32_t x, uint32_t size, uint32_t tiles, uint32_t *t0, uint32_t *t1, uint32_t *w)
+{
+	const uint64_t pos = (2 * (uint64_t) x + 1) * tiles;
+	const uint64_t den = 2 * (uint64_t) size;
+
+	*t0 = *t1 = *w = 0;
+	if (pos <= size)
+		return;
+	*t0 = (pos - size) / den;
+	*t1 = *t0 + 1;
+	*w = (pos - size) % den * 256 / den;
+	if (*t1 >= tiles) {
+		*t0 = *t1 = tiles - 1;
+		*w = 0;
+	}
+}
+
+// pas vrstic [row_begin, row_end), ki ga ena nit preslika z interpolacijo LUT ploščic
+typedef struct
+{
+	uint8_t *out;
+	const uint8_t *image;
+	uint32_t width, height, row_begin, row_end;
+	size_t pitch;
+	uint32_t bpp, tiles_x, tiles_y;
+	const uint8_t (*lut)[3][BINS];      // LUT ploščic po vrsticah ploščic
+	const uint32_t *tx0, *tx1, *wx;     // clahe_axis po stolpcih
+}
+clahe_band_t;
+
+static void *clahe_band(void *arg)
+{
+	clahe_band_t *band = arg;
+	const uint32_t bpp = band->bpp;
+
+	for (uint32_t y = band->row_begin; y < band->row_end; y++) {
+		uint32_t ty0, ty1, wy;
+		clahe_axis(y, band->height, band->tiles_y, &ty0, &ty1, &wy);
+		const uint8_t (*top)[3][BINS] = band->lut + (size_t) ty0 * band->tiles_x;
+		const uint8_t (*bottom)[3][BINS] = band->lut + (size_t) ty1 * band->tiles_x;
+
+		const uint8_t *in = band->image + y * band->pitch;
+		uint8_t *out = band->out + (size_t) y * band->width * bpp;
+		for (uint32_t x = 0; x < band->width; x++, in += bpp, out += bpp) {
+			const uint32_t tx0 = band->tx0[x], tx1 = band->tx1[x], wx = band->wx[x];
+			// bajt k piksla je kanal 2 - k (B, G, R)
+			for (int k = 0; k < 3; k++) {
+				const uint8_t v = in[k];
+				const uint32_t t = (256 - wx) * top[tx0][2 - k][v] + wx * top[tx1][2 - k][v];
+				const uint32_t b = (256 - wx) * bottom[tx0][2 - k][v] + wx * bottom[tx1][2 - k][v];
+				out[k] = ((256 - wy) * t + wy * b + 32768) >> 16;
+			}
+			if (bpp == 4)
+				out[3] = in[3];
+		}
+	}
+
+	return NULL;
+}
+
+// CLAHE na CPE z istimi celoštevilskimi koraki kot clip_lut in apply_clahe, zato je
+// izhod enak kot na napravi: histogrami ploščic s histogramCPU_rects, LUT ploščic
+// na gostitelju, interpolacija po pasovih vrstic na threads nitih.
+void claheCPU(uint8_t *out, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch, uint32_t bpp,
+              uint32_t tiles_x, uint32_t tiles_y, float clip_limit, uint32_t threads, bool scalar)
+{
+	const uint32_t n = tiles_x * tiles_y;
+	hist_rect_t *tiles = malloc(n * sizeof(hist_rect_t));
+	histogram_t *H = malloc(n * sizeof(histogram_t));
+	uint8_t (*lut)[3][BINS] = malloc(n * sizeof(*lut));
+	uint32_t *axis = malloc(3 * (size_t) width * sizeof(uint32_t));
+
+	grid_rects(tiles, width, height, tiles_x, tiles_y);
+	histogramCPU_rects(H, image, pitch, bpp, tiles, n, threads, scalar);
+	const uint32_t clip = clahe_clip(clip_limit);
+	for (uint32_t t = 0; t < n; t++)
+		clahe_lut(&H[t], tiles[t].width * tiles[t].height, clip, lut[t]);
+
+	// vodoravne uteži so za vse vrstice enake
+	uint32_t *tx0 = axis, *tx1 = axis + width, *wx = axis + 2 * (size_t) width;
+	for (uint32_t x = 0; x < width; x++)
+		clahe_axis(x, width, tiles_x, &tx0[x], &tx1[x], &wx[x]);
+
+	if (threads == 0) threads = cpu_threads();
+	if (threads > height) threads = height > 0 ? height : 1;
+
+	clahe_band_t *bands = malloc(threads * sizeof(clahe_band_t));
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+
+	for (uint32_t t = 0; t < threads; t++) {
+		bands[t] = (clahe_band_t) { out, image, width, height, (uint64_t) height * t / threads,
+		                            (uint64_t) height * (t + 1) / threads, pitch, bpp, tiles_x, tiles_y,
+		                            (const uint8_t (*)[3][BINS]) lut, tx0, tx1, wx };
+	}
+
+	for (uint32_t t = 1; t < threads; t++)
+		pthread_create(&tids[t], NULL, clahe_band, &bands[t]);
+	clahe_band(&bands[0]);
+	for (uint32_t t = 1; t < threads; t++)
+		pthread_join(tids[t], NULL);
+
+	free(tids);
+	free(bands);
+	free(axis);
+	free(lut);
+	free(H);
+	free(tiles);
+}
+
+// poskrbi, da ima medpomnilnik *buf na napravi vsaj size bajtov
+static cl_int buffer_reserve(cl_context context, cl_mem *buf, size_t *capacity, size_t size, cl_mem_flags flags)
+{
+	if (size <= *capacity)
+		return CL_SUCCESS;
+
+	cl_int status;
+	if (*buf)
+		clReleaseMemObject(*buf);
+	*buf = clCreateBuffer(context, flags, size, NULL, &status);
+	*capacity = status == CL_SUCCESS ? size : 0;
+	if (status != CL_SUCCESS)
+		*buf = NULL;
+
+	return status;
+}
+
+// poskrbi, da ima medpomnilnik slike na napravi vsaj size bajtov
+static cl_int gpu_reserve(gpu_t *gpu, size_t size)
+{
+	return buffer_reserve(gpu->context, &gpu->img_mem_obj, &gpu->img_capacity, size, CL_MEM_READ_ONLY);
+}
+
+// pomnilnik za sliko; v načinu brez kopiranja poravnan tako, da ga naprava
+// lahko uporabi neposredno. Sprosti se s free().
+uint8_t *image_alloc(gpu_t *gpu, size_t size)
+{
+	if (!gpu || !gpu->zero_copy)
+		return malloc(size);
+
+	// aligned_alloc zahteva velikost, ki je večkratnik poravnave
+	size = (size + gpu->img_align - 1) / gpu->img_align * gpu->img_align;
+	return aligned_alloc(gpu->img_align, size);
+}
+
+// drevesno seštevanje groups delnih histogramov iz partial_mem_obj[0] v
+// hist_mem_obj; vsak korak zmanjša število vrstic za faktor REDUCE_CHUNK
+static cl_int enqueue_reduce(gpu_t *gpu, cl_command_queue queue, cl_mem hist_mem_obj, size_t groups, cl_event *events)
+{
+	cl_int status = CL_SUCCESS;
+	const cl_uint chunk = REDUCE_CHUNK;
+	int in = 0;
+	bool first = true;
+
+	while (status == CL_SUCCESS) {
+		const size_t slices = (groups - 1) / chunk + 1;
+		cl_mem out_mem_obj = hist_mem_obj;
+		if (slices > 1) {
+			status = buffer_reserve(gpu->context, &gpu->partial_mem_obj[1 - in], &gpu->partial_capacity[1 - in],
+			                        slices * sizeof(histogram_t), CL_MEM_READ_WRITE);
+			if (status != CL_SUCCESS)
+				return status;
+			out_mem_obj = gpu->partial_mem_obj[1 - in];
+		}
+
+		const cl_uint n = groups;
+		const cl_uint accumulate = slices == 1 && gpu->accumulate;
+		size_t global_item_size[] = { 3 * BINS, slices };
+		status = clSetKernelArg(gpu->reduce_kernel, 0, sizeof(cl_mem),  (void *) &gpu->partial_mem_obj[in]);
+		if (status == CL_SUCCESS)
+			status = clSetKernelArg(gpu->reduce_kernel, 1, sizeof(cl_mem),  (void *) &out_mem_obj);
+		if (status == CL_SUCCESS)
+			status = clSetKernelArg(gpu->reduce_kernel, 2, sizeof(cl_uint), (void *) &n);
+		if (status == CL_SUCCESS)
+			status = clSetKernelArg(gpu->reduce_kernel, 3, sizeof(cl_uint), (void *) &chunk);
+		if (status == CL_SUCCESS)
+			status = clSetKernelArg(gpu->reduce_kernel, 4, sizeof(cl_uint), (void *) &accumulate);
+		cl_event *ev = !events ? NULL : first ? &events[EV_REDUCE_FIRST] : slices == 1 ? &events[EV_REDUCE_LAST] : NULL;
+		if (status == CL_SUCCESS)
+			status = clEnqueueNDRangeKernel(queue, gpu->reduce_kernel, 2, NULL, global_item_size, NULL, 0, NULL, ev);
+		first = false;
+
+		if (slices == 1)
+			break;
+		groups = slices;
+		in = 1 - in;
+	}
+
+	return status;
+}
+
+uint32_t size_class(uint32_t width, uint32_t height)
+{
+	uint64_t pixels = (uint64_t) width * height;
+	uint32_t c = 0;
+	while (pixels >>= 1)
+		c++;
+	return c < TUNE_CLASSES ? c : TUNE_CLASSES - 1;
+}
+
+// wgsize > 0: kvadratna skupina wgsize x wgsize z gpu->variant, kot pri ročnem preletu;
+// wgsize == 0: uglašena nastavitev za razred velikosti slike, sicer privzeta skupina,
+// ki ne preseže CL_KERNEL_WORK_GROUP_SIZE
+config_t launch_config(gpu_t *gpu, uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	if (gpu->trial)
+		return *gpu->trial;
+	if (wgsize > 0)
+		return (config_t) { gpu->variant, wgsize, wgsize, 0 };
+
+	const config_t *tuned = &gpu->tuned[size_class(width, height)];
+	if (tuned->variant >= 0)
+		return *tuned;
+
+	uint32_t side = TUNE_DEFAULT_SIDE;
+	while (side > 1 && side * side > gpu->max_wg[gpu->variant])
+		side /= 2;
+	return (config_t) { gpu->variant, side, side, 0 };
+}
+
+// napolni hist_mem_obj z ničlami (razen pri gpu->accumulate) in zažene kernel nad
+// sliko v img_mem_obj; kernel počaka na dogodke v wait. Če events ni NULL, vanj
+// zapiše dogodke EV_FILL, EV_KERNEL in EV_REDUCE_*.
+cl_int enqueue_histogram(gpu_t *gpu, cl_command_queue queue, cl_mem img_mem_obj, cl_mem hist_mem_obj,
+                         uint32_t width, uint32_t height, uint32_t wgsize, cl_uint num_wait, const cl_event *wait,
+                         cl_event *events)
+{
+	cl_int status;
+	const config_t cfg = launch_config(gpu, width, height, wgsize);
+	const int variant = cfg.variant;
+	cl_kernel kernel = gpu->packed ? gpu->rgb_kernel : gpu->kernels[variant];
+	cl_uint work_dim;
+	size_t local_item_size[2], global_item_size[2], groups;
+
+	// Delitev dela
+	if (variant == KERNEL_COARSE || variant == KERNEL_REPL || gpu->packed) {
+		// 1D: toliko skupin, da zasedejo vse računske enote, vsaka nit pa
+		// obdela coarsening pikslov; manjše slike dobijo manj skupin. Pri
+		// stisnjenih pikslih je enota dela četverica pikslov.
+		const size_t pixels = (size_t) width * height;
+		const size_t unit = gpu->packed ? 4 : 1;
+		const size_t items = (pixels - 1) / unit + 1;
+		const size_t local = gpu->packed ? min((size_t) cfg.rows * cfg.cols, gpu->rgb_max_wg) : (size_t) cfg.rows * cfg.cols;
+		const size_t max_groups = (size_t) gpu->compute_units * GROUPS_PER_CU;
+		const size_t num_groups = min((items - 1) / local + 1, max_groups);
+		work_dim = 1;
+		local_item_size[0] = local;
+		global_item_size[0] = num_groups * local;
+		groups = num_groups;
+		gpu->coarsening = unit * ((items - 1) / global_item_size[0] + 1);
+	}
+	else if (variant == KERNEL_VEC) {
+		// vsaka nit prebere 4 sosednje piksle naenkrat
+		const uint32_t vec_width = (width - 1) / 4 + 1;
+		size_t num_groups[] = { (height - 1) / cfg.rows + 1 , (vec_width - 1) / cfg.cols + 1 };
+		work_dim = 2;
+		local_item_size[0] = cfg.rows;
+		local_item_size[1] = cfg.cols;
+		global_item_size[0] = num_groups[0] * local_item_size[0];
+		global_item_size[1] = num_groups[1] * local_item_size[1];
+		groups = num_groups[0] * num_groups[1];
+		gpu->coarsening = 4;
+	}
+	else {
+		size_t num_groups[] = { (height - 1) / cfg.rows + 1 , (width - 1) / cfg.cols + 1 };
+		work_dim = 2;
+		local_item_size[0] = cfg.rows;
+		local_item_size[1] = cfg.cols;
+		global_item_size[0] = num_groups[0] * local_item_size[0];
+		global_item_size[1] = num_groups[1] * local_item_size[1];
+		groups = num_groups[0] * num_groups[1];
+		gpu->coarsening = 1;
+	}
+	//printf("global_item_size (%u, %u)\n", global_item_size[0], global_item_size[1]);
+
+	// Pri veliko skupinah se globalne atomarne operacije na 768 koših gnetejo,
+	// zato vsaka skupina zapiše svoj delni histogram, ki ga nato sešteje
+	// reduce_histogram. Tabela delnih histogramov mora biti razumno velika.
+	const size_t partial_size = groups * sizeof(histogram_t);
+	gpu->two_phase = gpu->reduce == REDUCE_TWO_PHASE ||
+		(gpu->reduce == REDUCE_AUTO && groups >= TWO_PHASE_MIN_GROUPS && partial_size <= TWO_PHASE_MAX_BYTES);
+	if (gpu->two_phase) {
+		status = buffer_reserve(gpu->context, &gpu->partial_mem_obj[0], &gpu->partial_capacity[0], partial_size, CL_MEM_READ_WRITE);
+		if (status != CL_SUCCESS)
+			gpu->two_phase = false;
+	}
+	const cl_uint partial = gpu->two_phase;
+	cl_mem out_mem_obj = gpu->two_phase ? gpu->partial_mem_obj[0] : hist_mem_obj;
+
+	// kernel: argumenti
+	// vsak klic se izvede le, če so prejšnji uspeli; vrne se prva napaka
+	status = clSetKernelArg(kernel, 0, sizeof(cl_mem),  (void *) &img_mem_obj);
+	if (status == CL_SUCCESS)
+		status = clSetKernelArg(kernel, 1, sizeof(cl_mem),  (void *) &out_mem_obj);
+	if (status == CL_SUCCESS)
+		status = clSetKernelArg(kernel, 2, sizeof(cl_uint), (void *) &height);
+	if (status == CL_SUCCESS)
+		status = clSetKernelArg(kernel, 3, sizeof(cl_uint), (void *) &width);
+	if (status == CL_SUCCESS)
+		status = clSetKernelArg(kernel, 4, sizeof(cl_uint), (void *) &partial);
+	if (status == CL_SUCCESS && variant == KERNEL_REPL && !gpu->packed) {
+		// kopij ne more biti več kot niti v skupini
+		const cl_uint copies = min(gpu->copies, local_item_size[0]);
+		status = clSetKernelArg(kernel, 5, copies * 3 * gpu->bins * sizeof(cl_uint), NULL);
+		if (status == CL_SUCCESS)
+			status = clSetKernelArg(kernel, 6, sizeof(cl_uint), (void *) &copies);
+	}
+	//printf("arg: %s\n", cl_error(status));
+	if (status != CL_SUCCESS)
+		return status;
+
+	// delni histogrami se v celoti prepišejo, zato jih ni treba brisati; pri
+	// pasovih se histogram pobriše le pred prvim
+	if (!gpu->two_phase && !gpu->accumulate) {
+		status = clEnqueueFillBuffer(queue, hist_mem_obj, &zero, sizeof(uint32_t), 0, sizeof(histogram_t), 0, NULL,
+		                             events ? &events[EV_FILL] : NULL);
+		// printf("fill: %s\n", cl_error(status)); fflush(stdout);
+		if (status != CL_SUCCESS)
+			return status;
+	}
+
+	// kernel: zagon
+	status = clEnqueueNDRangeKernel(queue, kernel, work_dim, NULL, global_item_size, local_item_size, num_wait, wait,
+	                                events ? &events[EV_KERNEL] : NULL);
+	// printf("enqueue: %s\n", cl_error(status));
+	if (status != CL_SUCCESS)
+		return status;
+
+	if (gpu->two_phase)
+		status = enqueue_reduce(gpu, queue, hist_mem_obj, groups, events);
+
+	return status;
+}
+
+// trajanje ukaza iz dogodka v sekundah
+static double event_seconds(cl_event start, cl_event end)
+{
+	cl_ulong t0 = 0, t1 = 0;
+	clGetEventProfilingInfo(start, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &t0, NULL);
+	clGetEventProfilingInfo(end, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &t1, NULL);
+	return (t1 - t0) / 1000000000.0;
+}
+
+// zabeleži čase faz iz dogodkov končanega klica in dogodke sprosti
+static void profile_add(profile_t *prof, cl_event *events)
+{
+	const int first[PHASES] = { EV_UPLOAD, EV_FILL, EV_KERNEL, EV_REDUCE_FIRST, EV_READ };
+
+	for (int p = 0; p < PHASES; p++) {
+		cl_event start = events[first[p]];
+		cl_event end = p == PHASE_REDUCE && events[EV_REDUCE_LAST] ? events[EV_REDUCE_LAST] : start;
+		if (!start) continue;
+
+		if (prof->n[p] == prof->cap[p]) {
+			prof->cap[p] = prof->cap[p] ? 2 * prof->cap[p] : 64;
+			prof->t[p] = realloc(prof->t[p], prof->cap[p] * sizeof(double));
+		}
+		prof->t[p][prof->n[p]++] = event_seconds(start, end);
+	}
+
+	for (int e = 0; e < EVENTS; e++) {
+		if (events[e])
+			clReleaseEvent(events[e]);
+	}
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	const double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+// izpiše min/mediano/p99 faz od zadnjega poročila na stderr (tabela na stdout
+// ostane nedotaknjena), jih doda v CSV in pobriše
+void profile_report(profile_t *prof, const char *label, FILE *csv)
+{
+	for (int p = 0; p < PHASES; p++) {
+		const size_t n = prof->n[p];
+		if (n == 0) continue;
+
+		qsort(prof->t[p], n, sizeof(double), compare_doubles);
+		const double t_min = prof->t[p][0];
+		const double t_med = prof->t[p][n / 2];
+		const double t_p99 = prof->t[p][(n * 99 - 1) / 100];
+
+		// prepustnost glede na mediano: bajti za prenose, piksli za kernel
+		const double bytes = p == PHASE_UPLOAD ? prof->bytes_up : p == PHASE_READ ? prof->bytes_down : 0;
+		const double pixels = p == PHASE_KERNEL ? prof->pixels : 0;
+		const double bytes_s = t_med > 0 ? bytes / t_med : 0;
+		const double pixels_s = t_med > 0 ? pixels / t_med : 0;
+
+		fprintf(stderr, "%24s %-8s %12lf %12lf %12lf", label, phase_names[p], t_min, t_med, t_p99);
+		if (bytes > 0) fprintf(stderr, " %10.2lf MB/s", bytes_s / 1e6);
+		if (pixels > 0) fprintf(stderr, " %10.2lf Mpix/s", pixels_s / 1e6);
+		fprintf(stderr, "\n");
+
+		if (csv)
+			fprintf(csv, "%s,%s,%zu,%.9lf,%.9lf,%.9lf,%.1lf,%.1lf\n",
+				label, phase_names[p], n, t_min, t_med, t_p99, bytes_s, pixels_s);
+		prof->n[p] = 0;
+	}
+	if (csv)
+		fflush(csv);
+}
+
+// bajtov na piksel slike, ki jo dobi histogramGPU
+static size_t pixel_bytes(gpu_t *gpu)
+{
+	return gpu->packed ? 3 : 4;
+}
+
+// bajtov med začetki vrstic slike na gostitelju
+static size_t image_pitch(gpu_t *gpu, uint32_t width)
+{
+	return gpu->pitch ? gpu->pitch : width * pixel_bytes(gpu);
+}
+
+// Ovoj okoli pomnilnika gostitelja je mogoč le pri strnjenih vrsticah: kerneli
+// berejo piksle zaporedno, zato se vrstice z razmikom zberejo ob prenosu. Tudi
+// naslov mora biti poravnan na CL_DEVICE_MEM_BASE_ADDR_ALIGN (piksli za glavo
+// preslikane datoteke PPM niso), sicer gre slika po poti s kopijo.
+static bool wrap_host(gpu_t *gpu, const void *image, uint32_t width)
+{
+	return gpu->zero_copy && image_pitch(gpu, width) == width * pixel_bytes(gpu) &&
+	       (uintptr_t) image % gpu->base_align == 0;
+}
+
+// prenos rows vrstic iz src v strnjen medpomnilnik na napravi; vrstice z razmikom
+// zbere clEnqueueWriteBufferRect brez vmesne kopije na gostitelju
+static cl_int enqueue_upload(gpu_t *gpu, cl_command_queue queue, cl_mem mem_obj, const uint8_t *src, uint32_t width,
+                             uint32_t rows, cl_uint num_wait, const cl_event *wait, cl_event *ev)
+{
+	const size_t row_bytes = width * pixel_bytes(gpu);
+	const size_t pitch = image_pitch(gpu, width);
+	if (pitch == row_bytes || rows == 1)
+		return clEnqueueWriteBuffer(queue, mem_obj, CL_FALSE, 0, rows * row_bytes, src, num_wait, wait, ev);
+
+	const size_t origin[3] = { 0, 0, 0 };
+	const size_t region[3] = { row_bytes, rows, 1 };
+	return clEnqueueWriteBufferRect(queue, mem_obj, CL_FALSE, origin, origin, region, row_bytes, 0, pitch, 0,
+	                                src, num_wait, wait, ev);
+}
+
+// prenos slike, kernel in branje rezultata v ukazno vrsto naprave; v načinu
+// brez kopiranja vrne v *wrap ovoj slike, ki ga klicatelj sprosti, ko je vrsta končana
+cl_int enqueue_image(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize,
+                     cl_bool blocking, cl_mem *wrap, cl_event *ev)
+{
+	cl_int status;
+	const size_t img_size = (size_t) width * height * pixel_bytes(gpu);
+	cl_mem img_mem_obj;
+
+	*wrap = NULL;
+	if (wrap_host(gpu, image, width)) {
+		// ovoj okoli pomnilnika gostitelja, brez alokacije in prenosa
+		img_mem_obj = *wrap = clCreateBuffer(gpu->context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, img_size, image, &status);
+		//printf("wrap buffer: %s\n", cl_error(status));
+		if (status != CL_SUCCESS)
+			return status;
+	}
+	else {
+		// Alokacija pomnilnika na napravi (le ob prvi ali večji sliki)
+		status = gpu_reserve(gpu, img_size);
+		//printf("make buffer: %s\n", cl_error(status));
+		if (status != CL_SUCCESS)
+			return status;
+		img_mem_obj = gpu->img_mem_obj;
+
+		// Prenos slike; ukazna vrsta je urejena, zato kernel počaka na prenos
+		status = enqueue_upload(gpu, gpu->command_queue, img_mem_obj, image, width, height, 0, NULL,
+		                        ev ? &ev[EV_UPLOAD] : NULL);
+		//printf("write: %s\n", cl_error(status));
+		if (status != CL_SUCCESS)
+			return status;
+	}
+
+	status = enqueue_histogram(gpu, gpu->command_queue, img_mem_obj, gpu->hist_mem_obj, width, height, wgsize, 0, NULL, ev);
+	if (status != CL_SUCCESS)
+		return status;
+
+	// Kopiranje rezultatov; blokirajoče branje počaka tudi na prenos slike,
+	// zato lahko klicatelj po vrnitvi spet piše v image
+	status = clEnqueueReadBuffer(gpu->command_queue, gpu->hist_mem_obj, blocking, 0, sizeof(histogram_t), H, 0, NULL,
+	                             ev ? &ev[EV_READ] : NULL);
+	//printf("read: %s\n", cl_error(status));
+
+	return status;
+}
+
+// največji pas v bajtih: kerneli naslavljajo piksle z 32-bitnimi indeksi
+static size_t strip_limit(gpu_t *gpu)
+{
+	return min(min(gpu->strip_bytes, gpu->max_alloc), UINT32_MAX);
+}
+
+// Histogram po pasovih vrstic skozi obroč gpu->strips medpomnilnikov: pas s se
+// prenaša v svoji vrsti, medtem ko kernel obdeluje pas s - 1, in vsi se prištejejo
+// v isti hist_mem_obj. Vrstice vzame iz image ali, če je image NULL, z read_rows
+// v prav toliko medpomnilnikov gostitelja.
+static cl_int histogram_strips(gpu_t *gpu, histogram_t *H, uint8_t *image, hist_rows_fn read_rows, void *ctx,
+                               uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	cl_int status = CL_SUCCESS;
+	const size_t row_bytes = (size_t) width * pixel_bytes(gpu);
+	bool wrap = wrap_host(gpu, image, width);
+	if (width == 0 || height == 0) {
+		memset(H, 0, sizeof(histogram_t));
+		return CL_SUCCESS;
+	}
+	if (row_bytes > strip_limit(gpu))
+		return CL_INVALID_BUFFER_SIZE;
+
+	uint32_t rows = min(strip_limit(gpu) / row_bytes, height);
+	// pri 3 bajtih na piksel naj se pasovi začnejo na 4 bajte poravnani (vload3 v kernelu)
+	if (gpu->packed && rows > 4 && rows < height)
+		rows -= rows % 4;
+	const uint32_t strips = min(gpu->strips, (height - 1) / rows + 1);
+	const size_t strip_size = (size_t) rows * row_bytes;
+	// ovit pas mora biti poravnan kot slika; medpomnilniki za read_rows so vedno
+	if (image && rows < height && strip_size % gpu->base_align != 0)
+		wrap = false;
+
+	if (!wrap && !gpu->upload_queue) {
+		gpu->upload_queue = clCreateCommandQueue(gpu->context, gpu->device, 0, &status);
+		if (status != CL_SUCCESS)
+			return status;
+	}
+
+	uint8_t *staging[TILE_MAX_STRIPS] = { NULL };
+	cl_mem wraps[TILE_MAX_STRIPS] = { NULL };
+	cl_event ev_write[TILE_MAX_STRIPS] = { NULL }, ev_done[TILE_MAX_STRIPS] = { NULL };
+	for (uint32_t k = 0; k < strips && status == CL_SUCCESS; k++) {
+		if (!wrap)
+			status = buffer_reserve(gpu->context, &gpu->strip_mem_obj[k], &gpu->strip_capacity[k], strip_size, CL_MEM_READ_ONLY);
+		if (!image && !(staging[k] = image_alloc(gpu, strip_size)))
+			status = CL_OUT_OF_HOST_MEMORY;
+	}
+
+	gpu->accumulate = false;
+	for (uint32_t row = 0, s = 0; row < height && status == CL_SUCCESS; row += rows, s++) {
+		const uint32_t k = s % strips;
+		const uint32_t count = min(rows, height - row);
+		const size_t size = (size_t) count * row_bytes;
+
+		// medpomnilnik gostitelja je prost, ko je pas prenesen, pri ovoju pa šele po kernelu
+		cl_event *busy = wrap ? &ev_done[k] : &ev_write[k];
+		if (!image && *busy)
+			clWaitForEvents(1, busy);
+		if (wraps[k]) {
+			clWaitForEvents(1, &ev_done[k]);
+			clReleaseMemObject(wraps[k]);
+			wraps[k] = NULL;
+		}
+		if (ev_write[k]) {
+			clReleaseEvent(ev_write[k]);
+			ev_write[k] = NULL;
+		}
+
+		uint8_t *src = image ? image + row * image_pitch(gpu, width) : staging[k];
+		if (!image && !read_rows(ctx, src, row, count)) {
+			status = CL_INVALID_VALUE;
+			break;
+		}
+
+		cl_mem strip_mem_obj;
+		if (wrap) {
+			strip_mem_obj = wraps[k] = clCreateBuffer(gpu->context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, size, src, &status);
+			if (status != CL_SUCCESS)
+				break;
+		}
+		else {
+			// pas k se prepiše šele, ko ga prejšnji kernel ne bere več
+			strip_mem_obj = gpu->strip_mem_obj[k];
+			status = enqueue_upload(gpu, gpu->upload_queue, strip_mem_obj, src, width, count,
+			                        ev_done[k] ? 1 : 0, ev_done[k] ? &ev_done[k] : NULL, &ev_write[k]);
+			//printf("write strip: %s\n", cl_error(status));
+			clFlush(gpu->upload_queue);
+			if (status != CL_SUCCESS)
+				break;
+		}
+
+		cl_event events[EVENTS] = { NULL };
+		status = enqueue_histogram(gpu, gpu->command_queue, strip_mem_obj, gpu->hist_mem_obj, width, count, wgsize,
+		                           ev_write[k] ? 1 : 0, ev_write[k] ? &ev_write[k] : NULL, events);
+		clFlush(gpu->command_queue);
+		gpu->accumulate = true;
+
+		if (ev_done[k])
+			clReleaseEvent(ev_done[k]);
+		ev_done[k] = events[EV_KERNEL];
+		for (int e = 0; e < EVENTS; e++) {
+			if (e != EV_KERNEL && events[e])
+				clReleaseEvent(events[e]);
+		}
+	}
+	gpu->accumulate = false;
+
+	if (status == CL_SUCCESS)
+		status = clEnqueueReadBuffer(gpu->command_queue, gpu->hist_mem_obj, CL_TRUE, 0, sizeof(histogram_t), H, 0, NULL, NULL);
+	else
+		clFinish(gpu->command_queue);
+	if (gpu->upload_queue)
+		clFinish(gpu->upload_queue);
+
+	for (uint32_t k = 0; k < strips; k++) {
+		if (ev_write[k]) clReleaseEvent(ev_write[k]);
+		if (ev_done[k]) clReleaseEvent(ev_done[k]);
+		if (wraps[k]) clReleaseMemObject(wraps[k]);
+		free(staging[k]);
+	}
+
+	return status;
+}
+
+cl_int histogram_tiled(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	return histogram_strips(gpu, H, image, NULL, NULL, width, height, wgsize);
+}
+
+// slika, ki je ni v pomnilniku: gostitelj drži le gpu->strips pasov hkrati
+cl_int histogram_stream(gpu_t *gpu, histogram_t *H, hist_rows_fn read_rows, void *ctx,
+                        uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	// pasovi z read_rows so vedno strnjeni
+	const size_t pitch = gpu->pitch;
+	gpu->pitch = 0;
+	const cl_int status = histogram_strips(gpu, H, NULL, read_rows, ctx, width, height, wgsize);
+	gpu->pitch = pitch;
+	return status;
+}
+
+cl_int histogramGPU(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	const size_t img_size = (size_t) width * height * pixel_bytes(gpu);
+	if (img_size == 0) {
+		// prazen izrez: OpenCL ne dovoli praznih medpomnilnikov in zagonov
+		memset(H, 0, sizeof(histogram_t));
+		return CL_SUCCESS;
+	}
+	if (gpu->tiled == TILED_ON || (gpu->tiled == TILED_AUTO && img_size > min(gpu->max_alloc, UINT32_MAX)))
+		return histogram_tiled(gpu, H, image, width, height, wgsize);
+
+	cl_event events[EVENTS] = { NULL };
+	cl_event *ev = gpu->profiling ? events : NULL;
+	cl_mem wrap;
+
+	const cl_int status = enqueue_image(gpu, H, image, width, height, wgsize, CL_TRUE, &wrap, ev);
+
+	if (gpu->profiling && status == CL_SUCCESS) {
+		gpu->profile.bytes_up = wrap_host(gpu, image, width) ? 0 : img_size;
+		gpu->profile.bytes_down = sizeof(histogram_t);
+		gpu->profile.pixels = (size_t) width * height;
+		profile_add(&gpu->profile, events);
+	}
+
+	if (wrap)
+		clReleaseMemObject(wrap);
+
+	return status;
+}
+
+// histogram slike s stisnjenimi piksli BGR (decode_image_rgb)
+cl_int histogramGPU_rgb(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+{
+	gpu->packed = true;
+	const cl_int status = histogramGPU(gpu, H, image, width, height, wgsize);
+	gpu->packed = false;
+	return status;
+}
+
+// histogram dela slike: vrstice po width pikslov z bpp bajti (3 ali 4) se začnejo
+// pitch bajtov narazen; na napravo se prenesejo le piksli izreza
+cl_int histogramGPU_pitch(gpu_t *gpu, histogram_t *H, const uint8_t *image, uint32_t width, uint32_t height,
+                          size_t pitch, uint32_t bpp, uint32_t wgsize)
+{
+	gpu->packed = bpp == 3;
+	gpu->pitch = pitch;
+	const cl_int status = histogramGPU(gpu, H, (uint8_t *) image, width, height, wgsize);
+	gpu->pitch = 0;
+	gpu->packed = false;
+	return status;
+}
+
+// Cela slika na napravi: ovoj v *wrap (klicatelj ga sprosti) ali prenos v
+// gpu->img_mem_obj; vrstice z razmikom se zberejo ob prenosu.
+static cl_int upload_whole(gpu_t *gpu, const uint8_t *image, uint32_t width, uint32_t height, cl_mem *img_mem_obj,
+                           cl_mem *wrap)
+{
+	cl_int status;
+	const size_t img_size = (size_t) width * height * pixel_bytes(gpu);
+
+	*wrap = NULL;
+	if (wrap_host(gpu, image, width)) {
+		*img_mem_obj = *wrap = clCreateBuffer(gpu->context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, img_size,
+		                                      (void *) image, &status);
+		return status;
+	}
+
+	status = gpu_reserve(gpu, img_size);
+	if (status == CL_SUCCESS)
+		status = enqueue_upload(gpu, gpu->command_queue, gpu->img_mem_obj, image, width, height, 0, NULL, NULL);
+	*img_mem_obj = gpu->img_mem_obj;
+	return status;
+}
+
+// Zagon kernela, ki piše size bajtov slike v argument 1 (ostali argumenti so že
+// nastavljeni), in branje v out. V načinu brez kopiranja kernel piše neposredno
+// v out, če je ta dovolj poravnan, sicer v gpu->eq_mem_obj, ki se prebere.
+static cl_int kernel_to_host(gpu_t *gpu, cl_kernel kernel, cl_uint work_dim, const size_t *global_item_size,
+                             const size_t *local_item_size, uint8_t *out, size_t size)
+{
+	cl_int status;
+
+	if (gpu->zero_copy && (uintptr_t) out % gpu->base_align == 0) {
+		cl_mem out_mem_obj = clCreateBuffer(gpu->context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, size, out, &status);
+		if (status != CL_SUCCESS)
+			return status;
+		status  = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *) &out_mem_obj);
+		if (status == CL_SUCCESS)
+			status = clEnqueueNDRangeKernel(gpu->command_queue, kernel, work_dim, NULL, global_item_size,
+			                                local_item_size, 0, NULL, NULL);
+
+		// preslikava zagotovi, da gostitelj vidi, kar je zapisal kernel
+		if (status == CL_SUCCESS) {
+			void *mapped = clEnqueueMapBuffer(gpu->command_queue, out_mem_obj, CL_TRUE, CL_MAP_READ, 0, size, 0, NULL,
+			                                  NULL, &status);
+			if (status == CL_SUCCESS)
+				status = clEnqueueUnmapMemObject(gpu->command_queue, out_mem_obj, mapped, 0, NULL, NULL);
+			clFinish(gpu->command_queue);
+		}
+		clReleaseMemObject(out_mem_obj);
+		return status;
+	}
+
+	status = buffer_reserve(gpu->context, &gpu->eq_mem_obj, &gpu->eq_capacity, size, CL_MEM_WRITE_ONLY);
+	if (status == CL_SUCCESS)
+		status = clSetKernelArg(kernel, 1, sizeof(cl_mem), (void *) &gpu->eq_mem_obj);
+	if (status == CL_SUCCESS)
+		status = clEnqueueNDRangeKernel(gpu->command_queue, kernel, work_dim, NULL, global_item_size, local_item_size,
+		                                0, NULL, NULL);
+	//printf("kernel to host: %s\n", cl_error(status));
+	if (status == CL_SUCCESS)
+		status = clEnqueueReadBuffer(gpu->command_queue, gpu->eq_mem_obj, CL_TRUE, 0, size, out, 0, NULL, NULL);
+	return status;
+}
+
+// apply_lut nad pixels piksli iz img_mem_obj v out z LUT iz gpu->lut_mem_obj
+static cl_int apply_lut_to_host(gpu_t *gpu, cl_mem img_mem_obj, uint8_t *out, size_t pixels, cl_uint bpp)
+{
+	const cl_uint n = pixels;
+	const size_t local = min(256, gpu->apply_max_wg);
+	const size_t groups = min((pixels - 1) / local + 1, (size_t) gpu->compute_units * GROUPS_PER_CU);
+	const size_t global_item_size = groups * local;
+
+	cl_int status;
+	status  = clSetKernelArg(gpu->apply_kernel, 0, sizeof(cl_mem),  (void *) &img_mem_obj);
+	status |= clSetKernelArg(gpu->apply_kernel, 2, sizeof(cl_mem),  (void *) &gpu->lut_mem_obj);
+	status |= clSetKernelArg(gpu->apply_kernel, 3, sizeof(cl_uint), (void *) &n);
+	status |= clSetKernelArg(gpu->apply_kernel, 4, sizeof(cl_uint), (void *) &bpp);
+	if (status != CL_SUCCESS)
+		return status;
+
+	return kernel_to_host(gpu, gpu->apply_kernel, 1, &global_item_size, &local, out, pixels * bpp);
+}
+
+// Izenačenje histograma na napravi: histogram (enqueue_histogram), CDF in LUT
+// (calc_lut) in preslikava (apply_lut) v eni ukazni vrsti brez branja vmesnih
+// rezultatov; prebere se le out (brez razmika med vrsticami). Slika, ki gre v en
+// medpomnilnik, se prenese enkrat in ostane na napravi za preslikavo; večja se
+// pretaka po pasovih dvakrat. calc_lut zahteva skupino 256 niti.
+cl_int equalizeGPU(gpu_t *gpu, uint8_t *out, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch,
+                   uint32_t bpp, uint32_t wgsize)
+{
+	const size_t row_bytes = (size_t) width * bpp;
+	const size_t img_size = row_bytes * height;
+	if (img_size == 0)
+		return CL_SUCCESS;
+	if (gpu->lut_max_wg < BINS)
+		return CL_INVALID_WORK_GROUP_SIZE;
+
+	gpu->packed = bpp == 3;
+	gpu->pitch = pitch;
+	const bool whole = gpu->tiled != TILED_ON && img_size <= min(gpu->max_alloc, UINT32_MAX);
+	cl_mem img_mem_obj = NULL, wrap = NULL;
+	cl_int status = buffer_reserve(gpu->context, &gpu->lut_mem_obj, &gpu->lut_capacity, 3 * BINS, CL_MEM_READ_WRITE);
+
+	// 1. histogram v gpu->hist_mem_obj
+	if (status == CL_SUCCESS && whole) {
+		status = upload_whole(gpu, image, width, height, &img_mem_obj, &wrap);
+		if (status == CL_SUCCESS)
+			status = enqueue_histogram(gpu, gpu->command_queue, img_mem_obj, gpu->hist_mem_obj, width, height, wgsize,
+			                           0, NULL, NULL);
+	}
+	else if (status == CL_SUCCESS) {
+		histogram_t H;
+		status = histogram_tiled(gpu, &H, (uint8_t *) image, width, height, wgsize);
+	}
+
+	// 2. CDF in LUT, skupina na kanal
+	if (status == CL_SUCCESS) {
+		const size_t global_item_size[2] = { BINS, 3 };
+		const size_t local_item_size[2] = { BINS, 1 };
+		status  = clSetKernelArg(gpu->lut_kernel, 0, sizeof(cl_mem), (void *) &gpu->hist_mem_obj);
+		status |= clSetKernelArg(gpu->lut_kernel, 1, sizeof(cl_mem), (void *) &gpu->lut_mem_obj);
+		if (status == CL_SUCCESS)
+			status = clEnqueueNDRangeKernel(gpu->command_queue, gpu->lut_kernel, 2, NULL, global_item_size,
+			                                local_item_size, 0, NULL, NULL);
+		//printf("kernel lut: %s\n", cl_error(status));
+	}
+
+	// 3. preslikava: cela slika je že na napravi, pasovi se prenesejo še enkrat
+	if (status == CL_SUCCESS && whole)
+		status = apply_lut_to_host(gpu, img_mem_obj, out, (size_t) width * height, bpp);
+	for (uint32_t row = 0, rows = strip_limit(gpu) / row_bytes; !whole && row < height && status == CL_SUCCESS; row += rows) {
+		const uint32_t count = min(rows, height - row);
+		status = gpu_reserve(gpu, count * row_bytes);
+		if (status == CL_SUCCESS)
+			status = enqueue_upload(gpu, gpu->command_queue, gpu->img_mem_obj, image + row * image_pitch(gpu, width),
+			                        width, count, 0, NULL, NULL);
+		if (status == CL_SUCCESS)
+			status = apply_lut_to_host(gpu, gpu->img_mem_obj, out + row * row_bytes, (size_t) count * width, bpp);
+	}
+
+	if (status != CL_SUCCESS)
+		clFinish(gpu->command_queue);
+	if (wrap)
+		clReleaseMemObject(wrap);
+	gpu->pitch = 0;
+	gpu->packed = false;
+	return status;
+}
+
+// izrezi in njihovi histogrami na napravi, histogrami postavljeni na 0
+static cl_int rects_upload(gpu_t *gpu, const hist_rect_t *rects, uint32_t n)
+{
+	cl_int status = buffer_reserve(gpu->context, &gpu->rects_mem_obj, &gpu->rects_capacity, n * sizeof(cl_uint4),
+	                               CL_MEM_READ_ONLY);
+	if (status == CL_SUCCESS)
+		status = buffer_reserve(gpu->context, &gpu->tiles_mem_obj, &gpu->tiles_capacity, n * sizeof(histogram_t),
+		                        CL_MEM_READ_WRITE);
+	if (status != CL_SUCCESS)
+		return status;
+
+	// hist_rect_t je enak cl_uint4 (x, y, širina, višina)
+	status = clEnqueueWriteBuffer(gpu->command_queue, gpu->rects_mem_obj, CL_FALSE, 0, n * sizeof(cl_uint4), rects,
+	                              0, NULL, NULL);
+	//printf("write rects: %s\n", cl_error(status));
+	if (status != CL_SUCCESS)
+		return status;
+
+	return clEnqueueFillBuffer(gpu->command_queue, gpu->tiles_mem_obj, &zero, sizeof(zero), 0, n * sizeof(histogram_t),
+	                           0, NULL, NULL);
+}
+
+// calc_histogram_rects nad vrsticami [row, row + count) v img_mem_obj; skupin na
+// izrez toliko, da jih je skupaj približno GROUPS_PER_CU na računsko enoto (span je
+// število vrstic, ki jih pokrivajo izrezi)
+static cl_int enqueue_rects_kernel(gpu_t *gpu, cl_mem img_mem_obj, cl_uint width, cl_uint bpp, cl_uint row,
+                                   cl_uint count, uint32_t n, uint32_t span, uint32_t wgsize)
+{
+	const size_t local = wgsize ? wgsize : min(256, gpu->rects_max_wg);
+	const size_t parts = max(1, min((size_t) gpu->compute_units * GROUPS_PER_CU / n, span));
+	const size_t global_item_size[2] = { local * parts, n };
+	const size_t local_item_size[2] = { local, 1 };
+
+	cl_int status;
+	status  = clSetKernelArg(gpu->rects_kernel, 0, sizeof(cl_mem), (void *) &img_mem_obj);
+	status |= clSetKernelArg(gpu->rects_kernel, 1, sizeof(cl_mem), (void *) &gpu->tiles_mem_obj);
+	status |= clSetKernelArg(gpu->rects_kernel, 2, sizeof(cl_mem), (void *) &gpu->rects_mem_obj);
+	status |= clSetKernelArg(gpu->rects_kernel, 3, sizeof(cl_uint), (void *) &width);
+	status |= clSetKernelArg(gpu->rects_kernel, 4, sizeof(cl_uint), (void *) &bpp);
+	status |= clSetKernelArg(gpu->rects_kernel, 5, sizeof(cl_uint), (void *) &row);
+	status |= clSetKernelArg(gpu->rects_kernel, 6, sizeof(cl_uint), (void *) &count);
+	if (status != CL_SUCCESS)
+		return status;
+
+	status = clEnqueueNDRangeKernel(gpu->command_queue, gpu->rects_kernel, 2, NULL, global_item_size, local_item_size,
+	                                0, NULL, NULL);
+	//printf("kernel rects: %s\n", cl_error(status));
+	return status;
+}
+
+// Histogrami izrezov v gpu->tiles_mem_obj; na napravo gredo le vrstice, ki jih
+// pokriva kak izrez, po pasovih, če ne gredo v en medpomnilnik. Stanje packed in
+// pitch nastavi klicatelj.
+static cl_int enqueue_rects(gpu_t *gpu, const uint8_t *image, uint32_t width, uint32_t height,
+                            const hist_rect_t *rects, uint32_t n, uint32_t wgsize)
+{
+	uint32_t top = height, bottom = 0;
+	for (uint32_t r = 0; r < n; r++) {
+		if (rects[r].width == 0 || rects[r].height == 0)
+			continue;
+		top = min(top, rects[r].y);
+		bottom = max(bottom, rects[r].y + rects[r].height);
+	}
+
+	const size_t row_bytes = (size_t) width * pixel_bytes(gpu);
+	const size_t used = (size_t) (bottom > top ? bottom - top : 0) * row_bytes;
+	const size_t limit = gpu->tiled == TILED_ON || used > min(gpu->max_alloc, UINT32_MAX) ? strip_limit(gpu) : used;
+	const uint32_t rows = row_bytes > 0 ? min(limit / row_bytes, height) : height;
+
+	cl_int status = rects_upload(gpu, rects, n);
+	if (status == CL_SUCCESS && top < bottom && rows == 0)
+		status = CL_INVALID_BUFFER_SIZE;
+
+	for (uint32_t row = top; row < bottom && status == CL_SUCCESS; row += rows) {
+		const uint32_t count = min(rows, bottom - row);
+		const uint8_t *src = image + row * image_pitch(gpu, width);
+
+		cl_mem img_mem_obj;
+		if (wrap_host(gpu, src, width)) {
+			img_mem_obj = clCreateBuffer(gpu->context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, count * row_bytes,
+			                             (void *) src, &status);
+			if (status != CL_SUCCESS)
+				break;
+		}
+		else {
+			// ukazna vrsta je urejena: naslednji pas se prepiše šele za prejšnjim kernelom
+			status = gpu_reserve(gpu, count * row_bytes);
+			if (status == CL_SUCCESS)
+				status = enqueue_upload(gpu, gpu->command_queue, gpu->img_mem_obj, src, width, count, 0, NULL, NULL);
+			if (status != CL_SUCCESS)
+				break;
+			img_mem_obj = gpu->img_mem_obj;
+		}
+
+		status = enqueue_rects_kernel(gpu, img_mem_obj, width, pixel_bytes(gpu), row, count, n, bottom - top, wgsize);
+
+		// ovoj se sprosti, ko ga kernel ne potrebuje več
+		if (img_mem_obj != gpu->img_mem_obj)
+			clReleaseMemObject(img_mem_obj);
+	}
+
+	return status;
+}
+
+// Histogrami izrezov v enem prehodu (calc_histogram_rects): vsaka skupina bere le
+// piksle enega izreza in lokalni histogram izprazni v njegovo vrstico. Izrezi
+// morajo biti znotraj slike.
+cl_int histogramGPU_rects(gpu_t *gpu, histogram_t *H, const uint8_t *image, uint32_t width, uint32_t height,
+                          size_t pitch, uint32_t bpp, const hist_rect_t *rects, uint32_t n, uint32_t wgsize)
+{
+	if (n == 0)
+		return CL_SUCCESS;
+
+	gpu->packed = bpp == 3;
+	gpu->pitch = pitch;
+	cl_int status = enqueue_rects(gpu, image, width, height, rects, n, wgsize);
+
+	if (status == CL_SUCCESS)
+		status = clEnqueueReadBuffer(gpu->command_queue, gpu->tiles_mem_obj, CL_TRUE, 0, n * sizeof(histogram_t), H,
+		                             0, NULL, NULL);
+	else
+		clFinish(gpu->command_queue);
+
+	gpu->pitch = 0;
+	gpu->packed = false;
+	return status;
+}
+
+// apply_clahe nad vrsticami [row, row + count) v img_mem_obj, izhod v out
+static cl_int apply_clahe_to_host(gpu_t *gpu, cl_mem img_mem_obj, uint8_t *out, cl_uint width, cl_uint height,
+                                  cl_uint row, cl_uint count, cl_uint bpp, cl_uint tiles_x, cl_uint tiles_y)
+{
+	// kvadratne skupine, da sosednji piksli berejo iste LUT
+	size_t side = 16;
+	while (side > 1 && side * side > gpu->clahe_max_wg)
+		side /= 2;
+	const size_t local_item_size[2] = { side, side };
+	const size_t global_item_size[2] = { (width - 1) / side * side + side, (count - 1) / side * side + side };
+
+	cl_int status;
+	status  = clSetKernelArg(gpu->clahe_kernel, 0, sizeof(cl_mem),  (void *) &img_mem_obj);
+	status |= clSetKernelArg(gpu->clahe_kernel, 2, sizeof(cl_mem),  (void *) &gpu->lut_mem_obj);
+	status |= clSetKernelArg(gpu->clahe_kernel, 3, sizeof(cl_uint), (void *) &width);
+	status |= clSetKernelArg(gpu->clahe_kernel, 4, sizeof(cl_uint), (void *) &height);
+	status |= clSetKernelArg(gpu->clahe_kernel, 5, sizeof(cl_uint), (void *) &row);
+	status |= clSetKernelArg(gpu->clahe_kernel, 6, sizeof(cl_uint), (void *) &count);
+	status |= clSetKernelArg(gpu->clahe_kernel, 7, sizeof(cl_uint), (void *) &bpp);
+	status |= clSetKernelArg(gpu->clahe_kernel, 8, sizeof(cl_uint), (void *) &tiles_x);
+	status |= clSetKernelArg(gpu->clahe_kernel, 9, sizeof(cl_uint), (void *) &tiles_y);
+	if (status != CL_SUCCESS)
+		return status;
+
+	return kernel_to_host(gpu, gpu->clahe_kernel, 2, global_item_size, local_item_size, out,
+	                      (size_t) count * width * bpp);
+}
+
+// CLAHE na napravi: histogrami ploščic (calc_histogram_rects), rezanje, CDF in LUT
+// ploščic (clip_lut) in interpolacija (apply_clahe) v eni ukazni vrsti; prebere se
+// le out. Slika, ki gre v en medpomnilnik, se prenese enkrat, večja po pasovih
+// dvakrat. clip_lut zahteva skupino 256 niti.
+cl_int claheGPU(gpu_t *gpu, uint8_t *out, const uint8_t *image, uint32_t width, uint32_t height, size_t pitch,
+                uint32_t bpp, uint32_t tiles_x, uint32_t tiles_y, float clip_limit, uint32_t wgsize)
+{
+	const size_t row_bytes = (size_t) width * bpp;
+	const size_t img_size = row_bytes * height;
+	const uint32_t n = tiles_x * tiles_y;
+	if (img_size == 0 || n == 0)
+		return CL_SUCCESS;
+	if (gpu->clip_max_wg < BINS)
+		return CL_INVALID_WORK_GROUP_SIZE;
+
+	hist_rect_t *tiles = malloc(n * sizeof(hist_rect_t));
+	if (!tiles)
+		return CL_OUT_OF_HOST_MEMORY;
+	grid_rects(tiles, width, height, tiles_x, tiles_y);
+
+	gpu->packed = bpp == 3;
+	gpu->pitch = pitch;
+	const bool whole = gpu->tiled != TILED_ON && img_size <= min(gpu->max_alloc, UINT32_MAX);
+	cl_mem img_mem_obj = NULL, wrap = NULL;
+	cl_int status = buffer_reserve(gpu->context, &gpu->lut_mem_obj, &gpu->lut_capacity, n * sizeof(histogram_t) / 4,
+	                               CL_MEM_READ_WRITE);
+
+	// 1. histogrami ploščic v gpu->tiles_mem_obj
+	if (status == CL_SUCCESS && whole) {
+		status = upload_whole(gpu, image, width, height, &img_mem_obj, &wrap);
+		if (status == CL_SUCCESS)
+			status = rects_upload(gpu, tiles, n);
+		if (status == CL_SUCCESS)
+			status = enqueue_rects_kernel(gpu, img_mem_obj, width, bpp, 0, height, n, height, wgsize);
+	}
+	else if (status == CL_SUCCESS)
+		status = enqueue_rects(gpu, image, width, height, tiles, n, wgsize);
+
+	// 2. rezanje, CDF in LUT, skupina na ploščico in kanal
+	if (status == CL_SUCCESS) {
+		const cl_uint clip = clahe_clip(clip_limit);
+		const size_t global_item_size[2] = { BINS, 3 * (size_t) n };
+		const size_t local_item_size[2] = { BINS, 1 };
+		status  = clSetKernelArg(gpu->clip_kernel, 0, sizeof(cl_mem),  (void *) &gpu->tiles_mem_obj);
+		status |= clSetKernelArg(gpu->clip_kernel, 1, sizeof(cl_mem),  (void *) &gpu->lut_mem_obj);
+		status |= clSetKernelArg(gpu->clip_kernel, 2, sizeof(cl_mem),  (void *) &gpu->rects_mem_obj);
+		status |= clSetKernelArg(gpu->clip_kernel, 3, sizeof(cl_uint), (void *) &clip);
+		if (status == CL_SUCCESS)
+			status = clEnqueueNDRangeKernel(gpu->command_queue, gpu->clip_kernel, 2, NULL, global_item_size,
+			                                local_item_size, 0, NULL, NULL);
+		//printf("kernel clip: %s\n", cl_error(status));
+	}
+
+	// 3. interpolacija: cela slika je že na napravi, pasovi se prenesejo še enkrat
+	if (status == CL_SUCCESS && whole)
+		status = apply_clahe_to_host(gpu, img_mem_obj, out, width, height, 0, height, bpp, tiles_x, tiles_y);
+	for (uint32_t row = 0, rows = strip_limit(gpu) / row_bytes; !whole && row < height && status == CL_SUCCESS; row += rows) {
+		const uint32_t count = min(rows, height - row);
+		status = gpu_reserve(gpu, count * row_bytes);
+		if (status == CL_SUCCESS)
+			status = enqueue_upload(gpu, gpu->command_queue, gpu->img_mem_obj, image + row * image_pitch(gpu, width),
+			                        width, count, 0, NULL, NULL);
+		if (status == CL_SUCCESS)
+			status = apply_clahe_to_host(gpu, gpu->img_mem_obj, out + row * row_bytes, width, height, row, count, bpp,
+			                             tiles_x, tiles_y);
+	}
+
+	if (status != CL_SUCCESS)
+		clFinish(gpu->command_queue);
+	if (wrap)
+		clReleaseMemObject(wrap);
+	free(tiles);
+	gpu->pitch = 0;
+	gpu->packed = false;
+	return status;
+}
+
+// Histogram ene slike na več napravah: vrstice se razdelijo sorazmerno s številom
+// računskih enot, vse naprave delajo hkrati, delni histogrami se seštejejo na gostitelju.
+// Vrne CL_SUCCESS ali prvo napako, ko so vse vrste končane; H je tedaj nepopoln.
+cl_int histogramGPU_multi(gpu_t *gpus, int n, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height,
+                          uint32_t wgsize)
+{
+	if (n == 1)
+		return histogramGPU(&gpus[0], H, image, width, height, wgsize);
+
+	histogram_t parts[MAX_DEVICES];
+	cl_mem wraps[MAX_DEVICES] = { NULL };
+	bool queued[MAX_DEVICES] = { false };  // v vrsto je šlo vsaj nekaj ukazov
+	bool used[MAX_DEVICES] = { false };    // vse je v vrsti, parts[d] bo veljaven
+	cl_int status = CL_SUCCESS;
+
+	uint32_t units = 0;
+	for (int d = 0; d < n; d++)
+		units += gpus[d].compute_units;
+
+	uint32_t row = 0, units_before = 0;
+	for (int d = 0; d < n; d++) {
+		units_before += gpus[d].compute_units;
+		const uint32_t end = d == n - 1 ? height : (uint32_t) ((uint64_t) height * units_before / units);
+		if (end > row) {
+			const cl_int enqueued = enqueue_image(&gpus[d], &parts[d], image + (size_t) row * width * 4, width, end - row,
+			                                      wgsize, CL_FALSE, &wraps[d], NULL);
+			clFlush(gpus[d].command_queue);
+			queued[d] = true;
+			used[d] = enqueued == CL_SUCCESS;
+			if (status == CL_SUCCESS)
+				status = enqueued;
+		}
+		row = end;
+	}
+
+	memset(H, 0, sizeof(histogram_t));
+	for (int d = 0; d < n; d++) {
+		if (!queued[d]) continue;
+		const cl_int finished = clFinish(gpus[d].command_queue);
+		if (status == CL_SUCCESS)
+			status = finished;
+		if (wraps[d])
+			clReleaseMemObject(wraps[d]);
+		for (int i = 0; used[d] && finished == CL_SUCCESS && i < BINS; i++) {
+			H->R[i] += parts[d].R[i];
+			H->G[i] += parts[d].G[i];
+			H->B[i] += parts[d].B[i];
+		}
+	}
+
+	return status;
+}
+
+typedef struct
+{
+	histogram_t H;
+	uint8_t *image;
+	uint32_t width, height, threads;
+	double seconds;
+}
+hybrid_cpu_t;
+
+static void *hybrid_cpu(void *arg)
+{
+	hybrid_cpu_t *c = arg;
+    struct timespec start, finish;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	histogramCPU_MT(&c->H, c->image, c->width, c->height, c->threads);
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	c->seconds = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	return NULL;
+}
+
+static double rate_update(double rate, size_t pixels, double seconds)
+{
+	if (pixels == 0 || seconds <= 0)
+		return rate;
+	const double measured = pixels / seconds;
+	return rate == 0 ? measured : HYBRID_EMA * measured + (1 - HYBRID_EMA) * rate;
+}
+
+// Hibridni histogram: zgornje vrstice obdela večnitna CPE, ostale GPE, hkrati.
+// Delež vrstic za CPE sledi izmerjenim hitrostim zadnjih slik, tako da obe strani
+// končata približno hkrati; hitrosti so v pikslih/s, da veljajo tudi za drugo širino.
+// Vrne CL_SUCCESS ali napako GPE; tudi ob napaki je H popoln, ker vrstice GPE
+// tedaj prešteje CPE, hitrost GPE pa se ne posodobi.
+cl_int histogram_hybrid(gpu_t *gpu, histogram_t *H, uint8_t *image, uint32_t width, uint32_t height, uint32_t wgsize)
+{
+    struct timespec start, finish;
+
+	double share = gpu->hybrid_share;
+	if (gpu->rate_cpu > 0 && gpu->rate_gpu > 0)
+		share = gpu->rate_cpu / (gpu->rate_cpu + gpu->rate_gpu);
+	if (share < HYBRID_MIN_SHARE) share = HYBRID_MIN_SHARE;
+	if (share > 1 - HYBRID_MIN_SHARE) share = 1 - HYBRID_MIN_SHARE;
+	gpu->hybrid_share = share;
+
+	const uint32_t cpu_rows = (uint32_t) (height * share + 0.5);
+	const uint32_t gpu_rows = height - cpu_rows;
+
+	// najprej GPE, da dela, medtem ko CPE računa svoj del
+	uint8_t *gpu_image = image + (size_t) cpu_rows * width * 4;
+	histogram_t G;
+	cl_mem wrap = NULL;
+	cl_int status = CL_SUCCESS;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	if (gpu_rows > 0) {
+		status = enqueue_image(gpu, &G, gpu_image, width, gpu_rows, wgsize, CL_FALSE, &wrap, NULL);
+		clFlush(gpu->command_queue);
+	}
+
+	hybrid_cpu_t c = { .image = image, .width = width, .height = cpu_rows, .threads = cpu_threads() };
+	pthread_t tid;
+	pthread_create(&tid, NULL, hybrid_cpu, &c);
+
+	if (gpu_rows > 0) {
+		const cl_int finished = clFinish(gpu->command_queue);
+		if (status == CL_SUCCESS)
+			status = finished;
+		if (wrap)
+			clReleaseMemObject(wrap);
+	}
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+	pthread_join(tid, NULL);
+
+	const double t_gpu = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+	if (status == CL_SUCCESS)
+		gpu->rate_gpu = rate_update(gpu->rate_gpu, (size_t) gpu_rows * width, t_gpu);
+	gpu->rate_cpu = rate_update(gpu->rate_cpu, (size_t) cpu_rows * width, c.seconds);
+
+	// GPE ni izračunala svojega dela: vrstice prešteje CPE
+	if (status != CL_SUCCESS) {
+		histogramCPU_MT(&G, gpu_image, width, gpu_rows, cpu_threads());
+		fold_bins(&G, 1, gpu->bins);
+	}
+
+	*H = c.H;
+	fold_bins(H, 1, gpu->bins);
+	for (int i = 0; gpu_rows > 0 && i < BINS; i++) {
+		H->R[i] += G.R[i];
+		H->G[i] += G.G[i];
+		H->B[i] += G.B[i];
+	}
+
+	return status;
+}
+
+void printHistogram(histogram_t *H) {
+	printf("Colour\tNo. Pixels\n");
+	for (int i = 0; i < BINS; i++) {
+		if (H->B[i] > 0)
+			printf("%dB\t%d\n", i, H->B[i]);
+		if (H->G[i] > 0)
+			printf("%dG\t%d\n", i, H->G[i]);
+		if (H->R[i] > 0)
+			printf("%dR\t%d\n", i, H->R[i]);
+	}
+}
+
+bool equal(histogram_t *A, histogram_t *B)
+{
+	for (int i = 0; i < BINS; i++) {
+		if (A->R[i] != B->R[i]) return false;
+		if (A->G[i] != B->G[i]) return false;
+		if (A->B[i] != B->B[i]) return false;
+	}
+	return true;
+}
+
+// čas histogramGPU z nastavitvijo cfg; INFINITY, če se rezultat ne ujema z referenco A
+static double tune_trial(gpu_t *gpu, const config_t *cfg, histogram_t *A, uint8_t *image, uint32_t width, uint32_t height)
+{
+    struct timespec start, finish;
+	histogram_t B;
+
+	gpu->trial = cfg;
+
+	// prvi zagon je ogrevanje in preverjanje; neveljaven zagon pusti napačen histogram
+	memset(&B, 0, sizeof(histogram_t));
+	histogramGPU(gpu, &B, image, width, height, 0);
+	if (!equal(A, &B)) {
+		gpu->trial = NULL;
+		return INFINITY;
+	}
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < TUNE_SAMPLES; i++)
+		histogramGPU(gpu, &B, image, width, height, 0);
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+
+	gpu->trial = NULL;
+	return ((finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1000000000.0) / TUNE_SAMPLES;
+}
+
+// Uglaševanje za razred velikosti slike: preizkusi vse različice kernela, 2D skupine
+// vseh oblik (tudi 1 x n in n x 1) ter 1D skupine, ki jih dovolita naprava in
+// CL_KERNEL_WORK_GROUP_SIZE, in najhitrejšo shrani v gpu->tuned.
+config_t autotune(gpu_t *gpu, uint8_t *image, uint32_t width, uint32_t height)
+{
+	histogram_t A;
+	histogramCPU(&A, image, width, height, 0);
+	fold_bins(&A, 1, gpu->bins);
+
+	size_t max_items[3] = { 1, 1, 1 };
+	clGetDeviceInfo(gpu->device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_items), max_items, NULL);
+
+	// meritve uglaševanja ne sodijo v profil
+	const bool profiling = gpu->profiling;
+	gpu->profiling = false;
+
+	config_t best = { -1, 0, 0, INFINITY };
+	for (int v = 0; v < KERNELS; v++) {
+		// manjše skupine od priporočenega večkratnika ne zapolnijo enot SIMD
+		size_t multiple = 1;
+		clGetKernelWorkGroupInfo(gpu->kernels[v], gpu->device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &multiple, NULL);
+		if (multiple == 0 || multiple > gpu->max_wg[v])
+			multiple = 1;
+
+		const bool one_dim = v == KERNEL_COARSE || v == KERNEL_REPL;
+		const size_t max_rows = one_dim ? 1 : max_items[0];
+		const size_t max_cols = one_dim ? max_items[0] : max_items[1];
+
+		for (uint32_t rows = 1; rows <= max_rows; rows *= 2) {
+			for (uint32_t cols = 1; cols <= max_cols; cols *= 2) {
+				const size_t items = (size_t) rows * cols;
+				if (items < multiple || items > gpu->max_wg[v])
+					continue;
+
+				config_t trial = { v, rows, cols, 0 };
+				trial.seconds = tune_trial(gpu, &trial, &A, image, width, height);
+				if (trial.seconds < best.seconds)
+					best = trial;
+			}
+		}
+	}
+
+	gpu->profiling = profiling;
+	if (best.variant >= 0)
+		gpu->tuned[size_class(width, height)] = best;
+
+	return best;
+}
+
+// Dekodira sliko v bpp bitov na piksel (32: BGRA, 24: stisnjeni BGR brez poravnave vrstic).
+// FreeImage_ConvertToRawBits le kopira vrstice, zato mora bitna slika že imeti bpp bitov.
+// Pri scale > 1 se JPEG dekodira pomanjšan (glej decode_image_scaled); v *full, če ni
+// NULL, zapiše število pikslov slike v polni velikosti.
+static bool decode_bits(gpu_t *gpu, const char *filename, unsigned bpp, uint32_t scale, uint8_t **image, size_t *capacity,
+                        uint32_t *width, uint32_t *height, uint64_t *full)
+{
+    // Load image from file; zapis po vsebini, sicer po končnici
+	FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filename, 0);
+	if (format == FIF_UNKNOWN)
+		format = FreeImage_GetFIFFromFilename(filename);
+	if (format == FIF_UNKNOWN)
+		return false;
+
+	// libjpeg zna sliko pomanjšati že pri inverzni DCT (1/2, 1/4, 1/8); FreeImage
+	// izbere največje zmanjšanje, pri katerem daljša stranica ostane vsaj size
+	int flags = 0;
+	uint64_t full_pixels = 0;
+	if (scale > 1 && format == FIF_JPEG) {
+		FIBITMAP *header = FreeImage_Load(format, filename, FIF_LOAD_NOPIXELS);
+		if (!header)
+			return false;
+		const uint32_t w = FreeImage_GetWidth(header), h = FreeImage_GetHeight(header);
+		FreeImage_Unload(header);
+
+		full_pixels = (uint64_t) w * h;
+		const uint32_t size = max(max(w, h) / scale, 1);
+		flags = JPEG_FAST | (size << 16);
+	}
+
+	FIBITMAP *imageJpeg = FreeImage_Load(format, filename, flags);
+	if (!imageJpeg)
+		return false;
+	// Convert it to a 32-bit (or 24-bit) image, unless it already is one
+	FIBITMAP *imageConv = FreeImage_GetBPP(imageJpeg) == bpp ? imageJpeg :
+		bpp == 24 ? FreeImage_ConvertTo24Bits(imageJpeg) : FreeImage_ConvertTo32Bits(imageJpeg);
+	if (!imageConv) {
+		FreeImage_Unload(imageJpeg);
+		return false;
+	}
+
+    // Get image dimensions
+    *width  = FreeImage_GetWidth(imageConv);
+	*height = FreeImage_GetHeight(imageConv);
+	uint32_t pitch  = *width * (bpp / 8);
+	// Preapare room for a raw data copy of the image
+	const size_t size = (size_t) *height * pitch * sizeof(uint8_t);
+	if (size > *capacity) {
+		free(*image);
+		*image = image_alloc(gpu, size);
+		*capacity = *image ? size : 0;
+		if (!*image) {
+			if (imageConv != imageJpeg)
+				FreeImage_Unload(imageConv);
+			FreeImage_Unload(imageJpeg);
+			return false;
+		}
+	}
+
+    // Extract raw data from the image (straight into device-visible memory in zero-copy mode)
+	FreeImage_ConvertToRawBits(*image, imageConv, pitch, bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, TRUE);
+
+    // Free source image data
+	if (imageConv != imageJpeg)
+		FreeImage_Unload(imageConv);
+	FreeImage_Unload(imageJpeg);
+
+	if (full)
+		*full = full_pixels ? full_pixels : (uint64_t) *width * *height;
+
+	return true;
+}
+
+// dekodira sliko v *image; obstoječi medpomnilnik se ponovno uporabi, če je dovolj velik
+bool decode_image(gpu_t *gpu, const char *filename, uint8_t **image, size_t *capacity, uint32_t *width, uint32_t *height)
+{
+	return decode_bits(gpu, filename, 32, 1, image, capacity, width, height, NULL);
+}
+
+// 3 bajti na piksel (B, G, R): četrtino manj pomnilnika in prenosa kot BGRA
+bool decode_image_rgb(gpu_t *gpu, const char *filename, uint8_t **image, size_t *capacity, uint32_t *width, uint32_t *height)
+{
+	return decode_bits(gpu, filename, 24, 1, image, capacity, width, height, NULL);
+}
+
+// JPEG, dekodiran v merilu približno 1/scale po vsaki stranici (scale 2, 4 ali 8) s
+// hitro inverzno DCT; drugi zapisi se dekodirajo v polni velikosti. *full je število
+// pikslov polne slike, s katerim scale_counts preračuna histogram.
+bool decode_image_scaled(gpu_t *gpu, const char *filename, uint32_t scale, uint8_t **image, size_t *capacity,
+                         uint32_t *width, uint32_t *height, uint64_t *full)
+{
+	return decode_bits(gpu, filename, 32, scale, image, capacity, width, height, full);
+}
+
+// histogram pomanjšane slike s pixels piksli prevede na sliko s full piksli
+void scale_counts(histogram_t *H, uint64_t full, uint64_t pixels)
+{
+	if (pixels == 0 || full == pixels)
+		return;
+
+	uint32_t *bins = (uint32_t *) H;
+	for (int i = 0; i < 3 * BINS; i++)
+		bins[i] = (bins[i] * full + pixels / 2) / pixels;
+}
+
+// Nestisnjene slike brez FreeImage: datoteka se preslika v pomnilnik in jedra
+// berejo piksle neposredno iz preslikave (na napravah z deljenim pomnilnikom tudi
+// kernel, sicer se prenos začne iz preslikave). Podprti zapisi:
+//   P6 (binarni PPM, maxval <= 255): piksli R, G, B
+//   surovi brez glave, *.bgra, *.rgba, *.bgr, *.rgb; mere iz HIST_RAW_SIZE=WxH
+//   ali iz imena datoteke (npr. cam0_1920x1080.bgra)
+//   Y4M (YUV4MPEG2, 8 bitov, C420*, C422, C444, mono): prva sličica se pretvori v BGR,
+//   ker jedra štejejo RGB, zato tu preslikava prihrani le dekodiranje in eno kopijo
+
+static void *map_file(const char *filename, size_t *size)
+{
+	const int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	void *map = NULL;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+			map = NULL;
+		else {
+			*size = st.st_size;
+			madvise(map, *size, MADV_SEQUENTIAL);
+		}
+	}
+	close(fd);
+
+	return map;
+}
+
+// naslednje število v glavi PPM; preskoči presledke in komentarje
+static bool ppm_number(const uint8_t *data, size_t size, size_t *pos, uint32_t *value)
+{
+	while (*pos < size && (isspace(data[*pos]) || data[*pos] == '#')) {
+		if (data[*pos] == '#') {
+			while (*pos < size && data[*pos] != '\n')
+				(*pos)++;
+		}
+		else
+			(*pos)++;
+	}
+	if (*pos >= size || !isdigit(data[*pos]))
+		return false;
+
+	uint64_t v = 0;
+	while (*pos < size && isdigit(data[*pos]) && v <= UINT32_MAX)
+		v = 10 * v + (data[(*pos)++] - '0');
+	*value = v;
+	return v <= UINT32_MAX;
+}
+
+static bool map_ppm(mapped_t *img)
+{
+	const uint8_t *data = img->map;
+	size_t pos = 2;
+	uint32_t maxval;
+
+	if (!ppm_number(data, img->map_size, &pos, &img->width) || !ppm_number(data, img->map_size, &pos, &img->height) ||
+	    !ppm_number(data, img->map_size, &pos, &maxval) || maxval == 0 || maxval > 255)
+		return false;
+	// glavo konča en presledek
+	pos++;
+
+	img->bpp = 3;
+	img->swap_rb = true;
+	img->pixels = data + pos;
+	return pos <= img->map_size && (uint64_t) img->width * img->height * 3 <= img->map_size - pos;
+}
+
+// mere surove slike iz HIST_RAW_SIZE ali zadnjega "<W>x<H>" v imenu datoteke
+static bool raw_size(const char *filename, uint32_t *width, uint32_t *height)
+{
+	const char *env = getenv("HIST_RAW_SIZE");
+	if (env)
+		return sscanf(env, "%ux%u", width, height) == 2;
+
+	const char *name = strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
+	bool found = false;
+	for (const char *c = name; *c; c++) {
+		uint32_t w, h;
+		if (isdigit(*c) && (c == name || !isdigit(c[-1])) && sscanf(c, "%ux%u", &w, &h) == 2) {
+			*width = w;
+			*height = h;
+			found = true;
+		}
+	}
+	return found;
+}
+
+static bool map_raw(const char *filename, const char *ext, mapped_t *img)
+{
+	img->bpp = strlen(ext) == 4 ? 4 : 3;
+	img->swap_rb = ext[0] == 'r';
+	img->pixels = img->map;
+	return raw_size(filename, &img->width, &img->height) &&
+		(uint64_t) img->width * img->height * img->bpp <= img->map_size;
+}
+
+static uint8_t clamp_byte(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// prva sličica Y4M v BGR; BT.601, omejen obseg, razen pri XCOLORRANGE=FULL
+static bool map_y4m(mapped_t *img)
+{
+	const uint8_t *data = img->map;
+	const uint8_t *end = data + img->map_size;
+	const uint8_t *eol = memchr(data, '\n', img->map_size);
+	if (!eol)
+		return false;
+
+	uint32_t sub_x = 2, sub_y = 2;     // C420jpeg je privzet
+	bool mono = false, full = false;
+	img->width = img->height = 0;
+	for (const uint8_t *t = data + 9; t < eol; t++) {
+		if (t[-1] != ' ')
+			continue;
+		char token[32];
+		const size_t len = min(strcspn((const char *) t, " \n"), sizeof(token) - 1);
+		memcpy(token, t, len);
+		token[len] = '\0';
+
+		if (token[0] == 'W')
+			img->width = atoi(token + 1);
+		else if (token[0] == 'H')
+			img->height = atoi(token + 1);
+		else if (token[0] == 'C') {
+			if (strncmp(token, "C420", 4) == 0 && !strstr(token, "p1"))
+				sub_x = sub_y = 2;
+			else if (strcmp(token, "C422") == 0)
+				sub_x = 2, sub_y = 1;
+			else if (strcmp(token, "C444") == 0)
+				sub_x = sub_y = 1;
+			else if (strcmp(token, "Cmono") == 0)
+				mono = true;
+			else
+				return false;   // več kot 8 bitov ali alfa
+		}
+		else if (strcmp(token, "XCOLORRANGE=FULL") == 0)
+			full = true;
+	}
+	if (img->width == 0 || img->height == 0)
+		return false;
+
+	// glava sličice: FRAME[ parametri]\n
+	const uint8_t *frame = eol + 1;
+	if (end - frame < 5 || memcmp(frame, "FRAME", 5) != 0 || !(frame = memchr(frame, '\n', end - frame)))
+		return false;
+	frame++;
+
+	const size_t w = img->width, h = img->height;
+	const size_t cw = (w + sub_x - 1) / sub_x, ch = (h + sub_y - 1) / sub_y;
+	if ((size_t) (end - frame) < w * h + (mono ? 0 : 2 * cw * ch))
+		return false;
+	const uint8_t *Y = frame, *U = frame + w * h, *V = U + cw * ch;
+
+	img->buffer = malloc(w * h * 3);
+	if (!img->buffer)
+		return false;
+	for (size_t i = 0; i < h; i++) {
+		uint8_t *out = img->buffer + i * w * 3;
+		for (size_t j = 0; j < w; j++) {
+			const size_t c = (i / sub_y) * cw + j / sub_x;
+			const int d = mono ? 0 : U[c] - 128, e = mono ? 0 : V[c] - 128;
+			if (full) {
+				const int y = Y[i * w + j];
+				out[3 * j + 0] = clamp_byte(y + ((454 * d + 128) >> 8));
+				out[3 * j + 1] = clamp_byte(y - ((88 * d + 183 * e + 128) >> 8));
+				out[3 * j + 2] = clamp_byte(y + ((359 * e + 128) >> 8));
+			}
+			else {
+				const int y = 298 * (Y[i * w + j] - 16);
+				out[3 * j + 0] = clamp_byte((y + 516 * d + 128) >> 8);
+				out[3 * j + 1] = clamp_byte((y - 100 * d - 208 * e + 128) >> 8);
+				out[3 * j + 2] = clamp_byte((y + 409 * e + 128) >> 8);
+			}
+		}
+	}
+
+	img->bpp = 3;
+	img->swap_rb = false;
+	img->pixels = img->buffer;
+	return true;
+}
+
+// MAPPED_OK: slika je v img in se sprosti z unmap_image; MAPPED_NO: zapis ni
+// med zgornjimi (klicatelj naj uporabi decode_image); MAPPED_ERROR: datoteke ni
+// ali je pokvarjena
+int map_image(const char *filename, mapped_t *img)
+{
+	memset(img, 0, sizeof(mapped_t));
+
+	const char *dot = strrchr(filename, '.');
+	const char *ext = dot ? dot + 1 : "";
+	const bool raw = strcasecmp(ext, "bgra") == 0 || strcasecmp(ext, "rgba") == 0 ||
+		strcasecmp(ext, "bgr") == 0 || strcasecmp(ext, "rgb") == 0;
+	const bool ppm = strcasecmp(ext, "ppm") == 0, y4m = strcasecmp(ext, "y4m") == 0;
+
+	// zapis po vsebini; brez preslikave, če datoteke ne bomo brali sami
+	FILE *f = fopen(filename, "rb");
+	if (!f)
+		return MAPPED_ERROR;
+	char magic[10] = { 0 };
+	const size_t got = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+	const bool is_ppm = got >= 3 && magic[0] == 'P' && magic[1] == '6' && isspace((unsigned char) magic[2]);
+	const bool is_y4m = got >= 10 && memcmp(magic, "YUV4MPEG2 ", 10) == 0;
+	if (!is_ppm && !is_y4m && !raw)
+		return ppm || y4m ? MAPPED_ERROR : MAPPED_NO;
+
+	img->map = map_file(filename, &img->map_size);
+	if (!img->map)
+		return MAPPED_ERROR;
+
+	char lower[5] = { 0 };
+	for (int i = 0; i < 4 && ext[i]; i++)
+		lower[i] = tolower((unsigned char) ext[i]);
+	const bool ok = is_ppm ? map_ppm(img) : is_y4m ? map_y4m(img) : map_raw(filename, lower, img);
+	if (!ok || img->width == 0 || img->height == 0) {
+		unmap_image(img);
+		return MAPPED_ERROR;
+	}
+
+	return MAPPED_OK;
+}
+
+void unmap_image(mapped_t *img)
+{
+	if (img->map)
+		munmap(img->map, img->map_size);
+	free(img->buffer);
+	memset(img, 0, sizeof(mapped_t));
+}
+
+static void swap_rb(histogram_t *H)
+{
+	uint32_t tmp[BINS];
+	memcpy(tmp, H->R, sizeof(tmp));
+	memcpy(H->R, H->B, sizeof(tmp));
+	memcpy(H->B, tmp, sizeof(tmp));
+}
+
+// histogram preslikane slike na GPE ali, pri gpu == NULL, na vseh jedrih CPE;
+// piksli se ne kopirajo, zamenjana R in B se popravita v histogramu; ovoj na GPE
+// je mogoč le, če je odmik pikslov za glavo poravnan (preveri wrap_host)
+cl_int histogram_mapped(gpu_t *gpu, histogram_t *H, const mapped_t *img, uint32_t wgsize)
+{
+	cl_int status = CL_SUCCESS;
+	uint8_t *pixels = (uint8_t *) img->pixels;     // jedra slike ne spreminjajo
+
+	if (!gpu && img->bpp == 4)
+		histogramCPU_MT(H, pixels, img->width, img->height, 0);
+	else if (!gpu)
+		histogramCPU_MT_rgb(H, pixels, img->width, img->height, 0);
+	else if (img->bpp == 4)
+		status = histogramGPU(gpu, H, pixels, img->width, img->height, wgsize);
+	else
+		status = histogramGPU_rgb(gpu, H, pixels, img->width, img->height, wgsize);
+
+	if (img->swap_rb)
+		swap_rb(H);
+	return status;
+}
+
+// Cevovod za serijo slik: niti dekodirajo vnaprej, glavna nit pošilja prenose
+// v svojo ukazno vrsto, kernele in branja pa v drugo, tako da se dekodiranje,
+// prenos slike i, kernel slike i-1 in branje slike i-2 prekrivajo.
+#define BATCH_DEPTH 3   // največ slik hkrati na napravi
+
+enum { SLOT_FREE, SLOT_DECODED, SLOT_QUEUED };
+
+typedef struct
+{
+	uint8_t *image;
+	size_t capacity;
+	uint32_t width, height;
+	int index;              // slika, ki jo reža drži ali čaka nanjo
+	int state;
+	bool ok;
+	uint64_t full;          // pikslov slike v polni velikosti (približni način)
+	cl_mem img_mem_obj, hist_mem_obj;
+	size_t img_capacity;
+	cl_event ev_read;
+	histogram_t H;
+}
+slot_t;
+
+typedef struct
+{
+	gpu_t *gpu;
+	const char **files;
+	int n, next;
+	uint32_t scale;         // 1: natančno, sicer JPEG v merilu 1/scale
+	slot_t *slots;
+	int nslots;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+}
+batch_t;
+
+static void *batch_decoder(void *arg)
+{
+	batch_t *b = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&b->lock);
+		const int i = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if (i >= b->n) break;
+
+		// počakaj, da glavna nit sprosti režo
+		slot_t *slot = &b->slots[i % b->nslots];
+		pthread_mutex_lock(&b->lock);
+		while (slot->state != SLOT_FREE || slot->index != i)
+			pthread_cond_wait(&b->cond, &b->lock);
+		pthread_mutex_unlock(&b->lock);
+
+		const bool ok = decode_image_scaled(b->gpu, b->files[i], b->scale, &slot->image, &slot->capacity,
+		                                    &slot->width, &slot->height, &slot->full);
+
+		pthread_mutex_lock(&b->lock);
+		slot->ok = ok;
+		slot->state = SLOT_DECODED;
+		pthread_cond_broadcast(&b->cond);
+		pthread_mutex_unlock(&b->lock);
+	}
+
+	return NULL;
+}
+
+// vrne CL_SUCCESS ali napako; ob napaki slika velja za neuspešno (slot->ok = false)
+// in ne ostane nič, na kar bi batch_retire čakal
+static cl_int batch_submit(gpu_t *gpu, cl_command_queue upload_queue, slot_t *slot, uint32_t wgsize)
+{
+	cl_int status;
+	const size_t img_size = (size_t) slot->width * slot->height * 4;
+	cl_event ev_write = NULL;
+
+	slot->ev_read = NULL;
+	if (gpu->zero_copy) {
+		slot->img_mem_obj = clCreateBuffer(gpu->context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, img_size, slot->image, &status);
+	}
+	else {
+		status = buffer_reserve(gpu->context, &slot->img_mem_obj, &slot->img_capacity, img_size, CL_MEM_READ_ONLY);
+		if (status == CL_SUCCESS)
+			status = clEnqueueWriteBuffer(upload_queue, slot->img_mem_obj, CL_FALSE, 0, img_size, slot->image, 0, NULL, &ev_write);
+		clFlush(upload_queue);
+	}
+
+	if (status == CL_SUCCESS)
+		status = enqueue_histogram(gpu, gpu->command_queue, slot->img_mem_obj, slot->hist_mem_obj,
+		                           slot->width, slot->height, wgsize, ev_write ? 1 : 0, &ev_write, NULL);
+	if (status == CL_SUCCESS)
+		status = clEnqueueReadBuffer(gpu->command_queue, slot->hist_mem_obj, CL_FALSE, 0, sizeof(histogram_t), &slot->H, 0, NULL, &slot->ev_read);
+	clFlush(gpu->command_queue);
+	//printf("submit: %s\n", cl_error(status));
+
+	if (status != CL_SUCCESS) {
+		// že vpisani ukazi se morajo končati, preden dekodirnik spet uporabi sliko
+		clFinish(upload_queue);
+		clFinish(gpu->command_queue);
+		if (slot->ev_read)
+			clReleaseEvent(slot->ev_read);
+		slot->ev_read = NULL;
+		if (gpu->zero_copy && slot->img_mem_obj)
+			clReleaseMemObject(slot->img_mem_obj);
+		if (gpu->zero_copy)
+			slot->img_mem_obj = NULL;
+		slot->ok = false;
+	}
+
+	if (ev_write)
+		clReleaseEvent(ev_write);
+	return status;
+}
+
+static void batch_retire(gpu_t *gpu, batch_t *b, int i, histogram_t *results, bool *ok)
+{
+	slot_t *slot = &b->slots[i % b->nslots];
+
+	if (slot->ok) {
+		clWaitForEvents(1, &slot->ev_read);
+		clReleaseEvent(slot->ev_read);
+		if (gpu->zero_copy)
+			clReleaseMemObject(slot->img_mem_obj);
+		results[i] = slot->H;
+		scale_counts(&results[i], slot->full, (uint64_t) slot->width * slot->height);
+	}
+	ok[i] = slot->ok;
+
+	pthread_mutex_lock(&b->lock);
+	slot->state = SLOT_FREE;
+	slot->index = i + b->nslots;
+	pthread_cond_broadcast(&b->cond);
+	pthread_mutex_unlock(&b->lock);
+}
+
+// histogrami n slik; ok[i] pove, ali se je slika i dala dekodirati. Pri scale > 1
+// so histogrami JPEG-ov približni (decode_image_scaled), števci pa preračunani na
+// polno velikost.
+void histogram_batch(gpu_t *gpu, const char **files, int n, histogram_t *results, bool *ok, uint32_t wgsize,
+                     uint32_t decoders, uint32_t scale)
+{
+	if (decoders == 0) decoders = cpu_threads() > 1 ? cpu_threads() - 1 : 1;
+
+	batch_t b = { .gpu = gpu, .files = files, .n = n, .next = 0, .scale = scale };
+	b.nslots = BATCH_DEPTH + decoders;
+	b.slots = calloc(b.nslots, sizeof(slot_t));
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.cond, NULL);
+
+	// prenosi gredo v svojo vrsto, da se lahko prekrivajo s kerneli
+	cl_command_queue upload_queue = clCreateCommandQueue(gpu->context, gpu->device, 0, NULL);
+
+	for (int s = 0; s < b.nslots; s++) {
+		b.slots[s].index = s;
+		b.slots[s].state = SLOT_FREE;
+		b.slots[s].hist_mem_obj = clCreateBuffer(gpu->context, CL_MEM_WRITE_ONLY, sizeof(histogram_t), NULL, NULL);
+	}
+
+	pthread_t *tids = malloc(decoders * sizeof(pthread_t));
+	for (uint32_t t = 0; t < decoders; t++)
+		pthread_create(&tids[t], NULL, batch_decoder, &b);
+
+	int oldest = 0;
+	for (int i = 0; i < n; i++) {
+		slot_t *slot = &b.slots[i % b.nslots];
+
+		pthread_mutex_lock(&b.lock);
+		while (slot->state != SLOT_DECODED || slot->index != i)
+			pthread_cond_wait(&b.cond, &b.lock);
+		pthread_mutex_unlock(&b.lock);
+
+		// na napravi je lahko največ BATCH_DEPTH slik
+		if (i - oldest == BATCH_DEPTH)
+			batch_retire(gpu, &b, oldest++, results, ok);
+
+		if (slot->ok)
+			batch_submit(gpu, upload_queue, slot, wgsize);
+
+		pthread_mutex_lock(&b.lock);
+		slot->state = SLOT_QUEUED;
+		pthread_mutex_unlock(&b.lock);
+	}
+	while (oldest < n)
+		batch_retire(gpu, &b, oldest++, results, ok);
+
+	for (uint32_t t = 0; t < decoders; t++)
+		pthread_join(tids[t], NULL);
+	free(tids);
+
+	for (int s = 0; s < b.nslots; s++) {
+		if (b.slots[s].img_mem_obj && !gpu->zero_copy)
+			clReleaseMemObject(b.slots[s].img_mem_obj);
+		clReleaseMemObject(b.slots[s].hist_mem_obj);
+		free(b.slots[s].image);
+	}
+	clReleaseCommandQueue(upload_queue);
+	pthread_cond_destroy(&b.cond);
+	pthread_mutex_destroy(&b.lock);
+	free(b.slots);
+}
+
+typedef struct
+{
+	gpu_t *gpu;
+	const char **files;
+	int n;
+	histogram_t *results;
+	bool *ok;
+	uint32_t wgsize, decoders, scale;
+}
+device_batch_t;
+
+static void *device_batch(void *arg)
+{
+	device_batch_t *db = arg;
+	histogram_batch(db->gpu, db->files, db->n, db->results, db->ok, db->wgsize, db->decoders, db->scale);
+	return NULL;
+}
+
+// serija slik na več napravah: slika i gre na napravo i % n, vsaka naprava ima svoj cevovod
+void histogram_batch_multi(gpu_t *gpus, int ndev, const char **files, int n, histogram_t *results, bool *ok,
+                           uint32_t wgsize, uint32_t decoders, uint32_t scale)
+{
+	if (ndev == 1) {
+		histogram_batch(&gpus[0], files, n, results, ok, wgsize, decoders, scale);
+		return;
+	}
+	if (decoders == 0) decoders = cpu_threads() > 1 ? cpu_threads() - 1 : 1;
+
+	device_batch_t db[MAX_DEVICES];
+	pthread_t tids[MAX_DEVICES];
+	for (int d = 0; d < ndev; d++) {
+		const int count = n / ndev + (d < n % ndev ? 1 : 0);
+		db[d] = (device_batch_t) {
+			.gpu = &gpus[d], .n = count, .wgsize = wgsize, .scale = scale,
+			.decoders = decoders / ndev > 0 ? decoders / ndev : 1,
+			.files = malloc(count * sizeof(char *)),
+			.results = malloc(count * sizeof(histogram_t)),
+			.ok = malloc(count * sizeof(bool))
+		};
+		for (int k = 0; k < count; k++)
+			db[d].files[k] = files[k * ndev + d];
+		pthread_create(&tids[d], NULL, device_batch, &db[d]);
+	}
+
+	for (int d = 0; d < ndev; d++) {
+		pthread_join(tids[d], NULL);
+		for (int k = 0; k < db[d].n; k++) {
+			results[k * ndev + d] = db[d].results[k];
+			ok[k * ndev + d] = db[d].ok[k];
+		}
+		free(db[d].files);
+		free(db[d].results);
+		free(db[d].ok);
+	}
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(const char **) a, *(const char **) b);
+}
+
+static bool is_jpeg(const char *name)
+{
+	const char *dot = strrchr(name, '.');
+	return dot && (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0);
+}
+
+// seznam datotek iz argumentov; imenik se razširi v svoje slike JPEG
+const char **collect_images(int argc, const char **argv, int *n)
+{
+	int cap = 64;
+	const char **files = malloc(cap * sizeof(char *));
+	*n = 0;
+
+	for (int a = 0; a < argc; a++) {
+		DIR *dir = opendir(argv[a]);
+		if (!dir) {
+			if (*n == cap) files = realloc(files, (cap *= 2) * sizeof(char *));
+			files[(*n)++] = strdup(argv[a]);
+			continue;
+		}
+
+		const int first = *n;
+		struct dirent *entry;
+		while ((entry = readdir(dir))) {
+			if (!is_jpeg(entry->d_name)) continue;
+
+			char *path = malloc(strlen(argv[a]) + strlen(entry->d_name) + 2);
+			sprintf(path, "%s/%s", argv[a], entry->d_name);
+			if (*n == cap) files = realloc(files, (cap *= 2) * sizeof(char *));
+			files[(*n)++] = path;
+		}
+		closedir(dir);
+		qsort(files + first, *n - first, sizeof(char *), compare_names);
+	}
+
+	return files;
+}
+
+// javni vmesnik (libhistogram.h)
+
+struct hist_handle
+{
+	hist_backend_t backend;
+	uint32_t bins;          // košev na kanal
+	gpu_t gpu;              // le pri HIST_BACKEND_OPENCL
+};
+
+static const char *backend_names[HIST_BACKENDS] = { "scalar", "threads", "simd", "opencl" };
+
+hist_t *hist_create(hist_backend_t backend, const char *device)
+{
+	return hist_create_bins(backend, device, BINS);
+}
+
+hist_t *hist_create_bins(hist_backend_t backend, const char *device, uint32_t bins)
+{
+	if (backend < 0 || backend >= HIST_BACKENDS || !valid_bins(bins))
+		return NULL;
+
+	hist_t *hist = calloc(1, sizeof(hist_t));
+	if (!hist)
+		return NULL;
+	hist->backend = backend;
+	hist->bins = bins;
+
+	if (backend == HIST_BACKEND_OPENCL && cl_init_devices_bins(&hist->gpu, 1, device, bins) < 0) {
+		free(hist);
+		return NULL;
+	}
+	if (backend == HIST_BACKEND_SIMD)
+		pthread_once(&simd_once, simd_detect);
+
+	return hist;
+}
+
+static const uint32_t layout_bpp[HIST_LAYOUTS] = { 4, 4, 3, 3 };
+
+// bajtov na piksel, v vrstici in med vrsticami; false pri neznani razporeditvi ali premajhnem pitch
+static bool image_format(const hist_image_t *image, uint32_t *bpp, size_t *row_bytes, size_t *pitch)
+{
+	if (image->layout < 0 || image->layout >= HIST_LAYOUTS)
+		return false;
+	*bpp = layout_bpp[image->layout];
+	*row_bytes = (size_t) image->width * *bpp;
+	*pitch = image->pitch ? image->pitch : *row_bytes;
+	return *pitch >= *row_bytes;
+}
+
+int hist_compute_image(hist_t *hist, const hist_image_t *image, histogram_t *H)
+{
+	uint32_t bpp;
+	size_t row_bytes, pitch;
+	if (!image_format(image, &bpp, &row_bytes, &pitch))
+		return CL_INVALID_VALUE;
+
+	int status = 0;
+	switch (hist->backend) {
+	case HIST_BACKEND_SCALAR:
+		histogramCPU_pitch(H, image->data, image->width, image->height, pitch, bpp, 1, true);
+		break;
+	case HIST_BACKEND_THREADS:
+		histogramCPU_pitch(H, image->data, image->width, image->height, pitch, bpp, 0, false);
+		break;
+	case HIST_BACKEND_SIMD:
+		histogramCPU_pitch(H, image->data, image->width, image->height, pitch, bpp, 1, false);
+		break;
+	case HIST_BACKEND_OPENCL:
+		status = histogramGPU_pitch(&hist->gpu, H, image->data, image->width, image->height,
+		                            pitch == row_bytes ? 0 : pitch, bpp, 0);
+		break;
+	default:
+		return CL_INVALID_VALUE;
+	}
+
+	// CPE šteje vse koše, naprava že stisnjene
+	if (hist->backend != HIST_BACKEND_OPENCL)
+		fold_bins(H, 1, hist->bins);
+
+	if (image->layout == HIST_LAYOUT_RGBA || image->layout == HIST_LAYOUT_RGB)
+		swap_rb(H);
+	return status;
+}
+
+// izrez, obrezan na sliko width x height
+static hist_rect_t clip_rect(hist_rect_t rect, uint32_t width, uint32_t height)
+{
+	rect.x = min(rect.x, width);
+	rect.y = min(rect.y, height);
+	rect.width = min(rect.width, width - rect.x);
+	rect.height = min(rect.height, height - rect.y);
+	return rect;
+}
+
+int hist_compute_rects(hist_t *hist, const hist_image_t *image, const hist_rect_t *rects, uint32_t n, histogram_t *H)
+{
+	uint32_t bpp;
+	size_t row_bytes, pitch;
+	if (!image_format(image, &bpp, &row_bytes, &pitch))
+		return CL_INVALID_VALUE;
+
+	hist_rect_t *clipped = malloc(max(n, 1) * sizeof(hist_rect_t));
+	if (!clipped)
+		return CL_OUT_OF_HOST_MEMORY;
+	for (uint32_t r = 0; r < n; r++)
+		clipped[r] = clip_rect(rects[r], image->width, image->height);
+
+	int status = 0;
+	switch (hist->backend) {
+	case HIST_BACKEND_SCALAR:
+		histogramCPU_rects(H, image->data, pitch, bpp, clipped, n, 1, true);
+		break;
+	case HIST_BACKEND_THREADS:
+		histogramCPU_rects(H, image->data, pitch, bpp, clipped, n, 0, false);
+		break;
+	case HIST_BACKEND_SIMD:
+		histogramCPU_rects(H, image->data, pitch, bpp, clipped, n, 1, false);
+		break;
+	case HIST_BACKEND_OPENCL:
+		status = histogramGPU_rects(&hist->gpu, H, image->data, image->width, image->height,
+		                            pitch == row_bytes ? 0 : pitch, bpp, clipped, n, 0);
+		break;
+	default:
+		status = CL_INVALID_VALUE;
+	}
+	free(clipped);
+
+	if (hist->backend != HIST_BACKEND_OPENCL)
+		fold_bins(H, n, hist->bins);
+
+	for (uint32_t r = 0; r < n && (image->layout == HIST_LAYOUT_RGBA || image->layout == HIST_LAYOUT_RGB); r++)
+		swap_rb(&H[r]);
+	return status;
+}
+
+int hist_compute_grid(hist_t *hist, const hist_image_t *image, uint32_t tiles_x, uint32_t tiles_y, histogram_t *H)
+{
+	const size_t n = (size_t) tiles_x * tiles_y;
+	if (n == 0 || n > UINT32_MAX)
+		return CL_INVALID_VALUE;
+
+	hist_rect_t *tiles = malloc(n * sizeof(hist_rect_t));
+	if (!tiles)
+		return CL_OUT_OF_HOST_MEMORY;
+	grid_rects(tiles, image->width, image->height, tiles_x, tiles_y);
+
+	const int status = hist_compute_rects(hist, image, tiles, n, H);
+	free(tiles);
+	return status;
+}
+
+int hist_equalize(hist_t *hist, const hist_image_t *image, uint8_t *out)
+{
+	uint32_t bpp;
+	size_t row_bytes, pitch;
+	if (!image_format(image, &bpp, &row_bytes, &pitch))
+		return CL_INVALID_VALUE;
+	if (hist->bins != BINS)
+		return CL_INVALID_OPERATION;
+
+	// LUT je po kanalu, zato razporeditev R in B ni pomembna
+	switch (hist->backend) {
+	case HIST_BACKEND_SCALAR:
+		equalizeCPU(out, image->data, image->width, image->height, pitch, bpp, 1, true);
+		return 0;
+	case HIST_BACKEND_THREADS:
+		equalizeCPU(out, image->data, image->width, image->height, pitch, bpp, 0, false);
+		return 0;
+	case HIST_BACKEND_SIMD:
+		equalizeCPU(out, image->data, image->width, image->height, pitch, bpp, 1, false);
+		return 0;
+	case HIST_BACKEND_OPENCL:
+		return equalizeGPU(&hist->gpu, out, image->data, image->width, image->height,
+		                   pitch == row_bytes ? 0 : pitch, bpp, 0);
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+int hist_clahe(hist_t *hist, const hist_image_t *image, uint32_t tiles_x, uint32_t tiles_y, float clip_limit,
+               uint8_t *out)
+{
+	uint32_t bpp;
+	size_t row_bytes, pitch;
+	if (!image_format(image, &bpp, &row_bytes, &pitch))
+		return CL_INVALID_VALUE;
+	const size_t n = (size_t) tiles_x * tiles_y;
+	if (n == 0 || n > UINT32_MAX / 3)
+		return CL_INVALID_VALUE;
+	if (hist->bins != BINS)
+		return CL_INVALID_OPERATION;
+
+	// rezanje in LUT sta po kanalu, zato razporeditev R in B ni pomembna
+	switch (hist->backend) {
+	case HIST_BACKEND_SCALAR:
+		claheCPU(out, image->data, image->width, image->height, pitch, bpp, tiles_x, tiles_y, clip_limit, 1, true);
+		return 0;
+	case HIST_BACKEND_THREADS:
+		claheCPU(out, image->data, image->width, image->height, pitch, bpp, tiles_x, tiles_y, clip_limit, 0, false);
+		return 0;
+	case HIST_BACKEND_SIMD:
+		claheCPU(out, image->data, image->width, image->height, pitch, bpp, tiles_x, tiles_y, clip_limit, 1, false);
+		return 0;
+	case HIST_BACKEND_OPENCL:
+		return claheGPU(&hist->gpu, out, image->data, image->width, image->height, pitch == row_bytes ? 0 : pitch, bpp,
+		                tiles_x, tiles_y, clip_limit, 0);
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+hist_image_t hist_image_roi(const hist_image_t *image, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+	hist_image_t roi = *image;
+	const uint32_t bpp = image->layout >= 0 && image->layout < HIST_LAYOUTS ? layout_bpp[image->layout] : 0;
+	const size_t pitch = image->pitch ? image->pitch : (size_t) image->width * bpp;
+
+	x = min(x, image->width);
+	y = min(y, image->height);
+	roi.width = min(width, image->width - x);
+	roi.height = min(height, image->height - y);
+	roi.data = image->data + y * pitch + (size_t) x * bpp;
+	roi.pitch = pitch;
+	return roi;
+}
+
+int hist_compute(hist_t *hist, const uint8_t *image, uint32_t width, uint32_t height, histogram_t *H)
+{
+	// noben zaledni sistem ne piše v sliko
+	uint8_t *pixels = (uint8_t *) image;
+
+	switch (hist->backend) {
+	case HIST_BACKEND_SCALAR:
+		histogramCPU(H, pixels, width, height, 0);
+		fold_bins(H, 1, hist->bins);
+		return 0;
+	case HIST_BACKEND_THREADS:
+		histogramCPU_MT(H, pixels, width, height, 0);
+		fold_bins(H, 1, hist->bins);
+		return 0;
+	case HIST_BACKEND_SIMD:
+		histogramSIMD(H, pixels, width, height, 0);
+		fold_bins(H, 1, hist->bins);
+		return 0;
+	case HIST_BACKEND_OPENCL:
+		return histogramGPU(&hist->gpu, H, pixels, width, height, 0);
+	default:
+		return CL_INVALID_VALUE;
+	}
+}
+
+int hist_compute_rows(hist_t *hist, hist_rows_fn read_rows, void *ctx, uint32_t width, uint32_t height, histogram_t *H)
+{
+	if (hist->backend == HIST_BACKEND_OPENCL)
+		return histogram_stream(&hist->gpu, H, read_rows, ctx, width, height, 0);
+
+	// CPE: en pas naenkrat, delni histogrami se seštejejo
+	const size_t row_bytes = (size_t) width * 4;
+	memset(H, 0, sizeof(histogram_t));
+	if (width == 0 || height == 0)
+		return 0;
+	const uint32_t rows = max(1, min(strip_bytes() / row_bytes, height));
+	uint8_t *strip = malloc((size_t) rows * row_bytes);
+	if (!strip)
+		return CL_OUT_OF_HOST_MEMORY;
+
+	for (uint32_t row = 0; row < height; row += rows) {
+		const uint32_t count = min(rows, height - row);
+		histogram_t part;
+		if (!read_rows(ctx, strip, row, count)) {
+			free(strip);
+			return CL_INVALID_VALUE;
+		}
+		const int status = hist_compute(hist, strip, width, count, &part);
+		if (status != 0) {
+			free(strip);
+			return status;
+		}
+		for (int i = 0; i < BINS; i++) {
+			H->R[i] += part.R[i];
+			H->G[i] += part.G[i];
+			H->B[i] += part.B[i];
+		}
+	}
+	free(strip);
+
+	return 0;
+}
+
+int hist_compute_file(hist_t *hist, const char *filename, histogram_t *H)
+{
+	mapped_t img;
+	const int mapped = map_image(filename, &img);
+	if (mapped == MAPPED_ERROR)
+		return CL_INVALID_VALUE;
+
+	if (mapped == MAPPED_NO) {
+		uint32_t width, height;
+		uint8_t *image = hist_load_image(filename, &width, &height);
+		if (!image)
+			return CL_INVALID_VALUE;
+		const int status = hist_compute(hist, image, width, height, H);
+		hist_free_image(image);
+		return status;
+	}
+
+	const hist_image_t image = {
+		.data = img.pixels, .width = img.width, .height = img.height,
+		.layout = img.bpp == 4 ? (img.swap_rb ? HIST_LAYOUT_RGBA : HIST_LAYOUT_BGRA)
+		                       : (img.swap_rb ? HIST_LAYOUT_RGB : HIST_LAYOUT_BGR)
+	};
+	const int status = hist_compute_image(hist, &image, H);
+
+	unmap_image(&img);
+	return status;
+}
+
+int hist_compute_file_scaled(hist_t *hist, const char *filename, uint32_t scale, histogram_t *H)
+{
+	if (scale <= 1)
+		return hist_compute_file(hist, filename, H);
+
+	uint8_t *image = NULL;
+	size_t capacity = 0;
+	uint32_t width, height;
+	uint64_t full;
+	if (!decode_image_scaled(NULL, filename, scale > 8 ? 8 : scale, &image, &capacity, &width, &height, &full)) {
+		free(image);
+		return CL_INVALID_VALUE;
+	}
+
+	const int status = hist_compute(hist, image, width, height, H);
+	scale_counts(H, full, (uint64_t) width * height);
+	free(image);
+
+	return status;
+}
+
+void hist_destroy(hist_t *hist)
+{
+	if (!hist)
+		return;
+	if (hist->backend == HIST_BACKEND_OPENCL)
+		cl_finalize(&hist->gpu);
+	free(hist);
+}
+
+hist_backend_t hist_backend(const hist_t *hist)
+{
+	return hist->backend;
+}
+
+uint32_t hist_bins(const hist_t *hist)
+{
+	return hist->bins;
+}
+
+const char *hist_backend_name(hist_backend_t backend)
+{
+	return backend >= 0 && backend < HIST_BACKENDS ? backend_names[backend] : "unknown";
+}
+
+uint8_t *hist_load_image(const char *filename, uint32_t *width, uint32_t *height)
+{
+	uint8_t *image = NULL;
+	size_t capacity = 0;
+
+	if (!decode_image(NULL, filename, &image, &capacity, width, height)) {
+		free(image);
+		return NULL;
+	}
+	return image;
+}
+
+void hist_free_image(uint8_t *image)
+{
+	free(image);
+}
+
+void hist_print(const histogram_t *H)
+{
+	printHistogram((histogram_t *) H);
+}
+
+int hist_equal(const histogram_t *A, const histogram_t *B)
+{
+	return equal((histogram_t *) A, (histogram_t *) B);
+}
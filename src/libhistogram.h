@@ -0,0 +1,162 @@
+#ifndef LIBHISTOGRAM_H
+#define LIBHISTOGRAM_H
+
+// libhistogram: barvni histogram slike BGRA (4 bajti na piksel, alfa se ne šteje)
+// na CPE ali napravi OpenCL. Ročaj ni deljen med nitmi: vsaka nit naj ima svojega.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define HIST_API __attribute__((visibility("default")))
+#else
+#define HIST_API
+#endif
+
+typedef struct
+{
+	uint32_t R[256];
+	uint32_t G[256];
+	uint32_t B[256];
+}
+histogram_t;
+
+typedef enum
+{
+	HIST_BACKEND_SCALAR,    // zaporedno, ena nit
+	HIST_BACKEND_THREADS,   // pasovi vrstic na vseh jedrih (HIST_THREADS)
+	HIST_BACKEND_SIMD,      // ena nit, SSE2/AVX2, kar procesor podpira
+	HIST_BACKEND_OPENCL,    // naprava OpenCL z uglašeno nastavitvijo zagona
+	HIST_BACKENDS
+}
+hist_backend_t;
+
+typedef struct hist_handle hist_t;
+
+// Ustvari ročaj za izbrani zaledni sistem. device je izbira naprave OpenCL
+// (indeks, gpu, cpu, all ali del imena; NULL = HIST_DEVICE ali vse GPE) in se
+// pri drugih zalednih sistemih ne upošteva. Vrne NULL, če naprave ni ali se
+// program OpenCL ne prevede.
+HIST_API hist_t *hist_create(hist_backend_t backend, const char *device);
+
+// Kot hist_create, histogrami pa imajo bins košev na kanal (potenca 2 od 1 do 256,
+// npr. 16, 32 ali 64). Koš b šteje vrednosti [b * 256 / bins, (b + 1) * 256 / bins) in je
+// v R[b], G[b], B[b], višji koši so 0. OpenCL prevede kernele za ta bins, zato so
+// lokalni histogrami manjši in jih je lahko več. Vrne NULL tudi pri neveljavnem
+// bins. hist_equalize in hist_clahe potrebujeta 256 košev, sicer vrneta
+// CL_INVALID_OPERATION (-59).
+HIST_API hist_t *hist_create_bins(hist_backend_t backend, const char *device, uint32_t bins);
+
+// Histogram slike width x height v H. Vrne 0 ali kodo napake OpenCL (< 0). Slika,
+// večja od največjega medpomnilnika naprave, se samodejno pretaka po pasovih.
+HIST_API int hist_compute(hist_t *hist, const uint8_t *image, uint32_t width, uint32_t height, histogram_t *H);
+
+// razporeditev kanalov v pikslu
+typedef enum
+{
+	HIST_LAYOUT_BGRA,
+	HIST_LAYOUT_RGBA,
+	HIST_LAYOUT_BGR,
+	HIST_LAYOUT_RGB,
+	HIST_LAYOUTS
+}
+hist_layout_t;
+
+// Opis slike v tujem pomnilniku: vrstice po width pikslov se začnejo pitch bajtov
+// narazen (0 = strnjene vrstice). Tako se opiše okvir s poravnanimi vrsticami ali
+// izrez večje slike, ne da bi se piksli kopirali.
+typedef struct
+{
+	const uint8_t *data;    // prvi piksel prve vrstice
+	uint32_t width, height;
+	size_t pitch;           // bajtov med začetki vrstic; 0 = width * bajtov na piksel
+	hist_layout_t layout;
+}
+hist_image_t;
+
+// Histogram opisane slike v H na katerem koli zalednem sistemu. Vrne 0 ali kodo
+// napake OpenCL (< 0); CL_INVALID_VALUE (-30) pri neznani razporeditvi ali pitch,
+// manjšem od vrstice.
+HIST_API int hist_compute_image(hist_t *hist, const hist_image_t *image, histogram_t *H);
+
+// Izrez width x height z levim zgornjim kotom (x, y); kaže v pomnilnik image z
+// istim pitch, zato mora image živeti, dokler se izrez uporablja. Izrez se
+// obreže na sliko.
+HIST_API hist_image_t hist_image_roi(const hist_image_t *image, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+
+// pravokotnik v pikslih; levi zgornji kot (x, y)
+typedef struct
+{
+	uint32_t x, y, width, height;
+}
+hist_rect_t;
+
+// Histogrami n izrezov v enem prehodu: H[r] je histogram izreza rects[r], obrezanega
+// na sliko. Izrezi se lahko prekrivajo. Vrne 0 ali kodo napake kot hist_compute_image.
+HIST_API int hist_compute_rects(hist_t *hist, const hist_image_t *image, const hist_rect_t *rects, uint32_t n,
+                                histogram_t *H);
+
+// Histogrami mreže tiles_x x tiles_y ploščic v enem prehodu; ploščica (tx, ty) je v
+// H[ty * tiles_x + tx] in pokriva stolpce [width * tx / tiles_x, width * (tx + 1) / tiles_x),
+// vrstice enako.
+HIST_API int hist_compute_grid(hist_t *hist, const hist_image_t *image, uint32_t tiles_x, uint32_t tiles_y,
+                               histogram_t *H);
+
+// Izenačenje histograma: vsak kanal se preslika skozi LUT iz svoje kumulativne
+// porazdelitve, alfa se prepiše. out dobi width * height pikslov v razporeditvi image
+// brez razmika med vrsticami. Pri OpenCL histogram, CDF in LUT ostanejo na napravi,
+// na gostitelja se prebere le out. Vrne 0 ali kodo napake kot hist_compute_image.
+HIST_API int hist_equalize(hist_t *hist, const hist_image_t *image, uint8_t *out);
+
+// CLAHE (adaptivno izenačenje z omejenim kontrastom): slika se razdeli na mrežo
+// tiles_x x tiles_y ploščic kot pri hist_compute_grid, histogram vsake ploščice se
+// po kanalih poreže pri clip_limit-kratniku povprečnega koša (<= 0 = brez rezanja),
+// presežek se razdeli po vseh koših, piksel pa se preslika z bilinearno interpolacijo
+// LUT štirih najbližjih ploščic. Alfa se prepiše, out je kot pri hist_equalize.
+// Vrne 0 ali kodo napake kot hist_compute_image; CL_INVALID_VALUE tudi pri prazni mreži.
+HIST_API int hist_clahe(hist_t *hist, const hist_image_t *image, uint32_t tiles_x, uint32_t tiles_y,
+                        float clip_limit, uint8_t *out);
+
+// Vrstice [first, first + count) slike v rows (count * width * 4 bajtov); vrne 0, če jih ne more dati.
+typedef int (*hist_rows_fn)(void *ctx, uint8_t *rows, uint32_t first, uint32_t count);
+
+// Histogram slike, ki je ni treba imeti v pomnilniku: vrstice se berejo po pasovih
+// z read_rows, zato pomnilnik gostitelja in naprave ne preseže nekaj pasov
+// (HIST_STRIP_MB, HIST_STRIPS). Vrne 0 ali kodo napake OpenCL (< 0); če read_rows
+// vrne 0, je koda CL_INVALID_VALUE (-30).
+HIST_API int hist_compute_rows(hist_t *hist, hist_rows_fn read_rows, void *ctx, uint32_t width, uint32_t height,
+                               histogram_t *H);
+
+// Histogram slike iz datoteke. Binarni PPM (P6), Y4M in surove slike *.bgra, *.rgba,
+// *.bgr, *.rgb (mere iz HIST_RAW_SIZE=WxH ali imena, npr. cam_1920x1080.bgra) se
+// preslikajo v pomnilnik in berejo brez kopiranja; drugo dekodira FreeImage.
+// Vrne 0 ali kodo napake (< 0); CL_INVALID_VALUE (-30), če datoteke ni mogoče prebrati.
+HIST_API int hist_compute_file(hist_t *hist, const char *filename, histogram_t *H);
+
+// Približni histogram za nadzor: JPEG se dekodira v merilu 1/scale (2, 4 ali 8) po
+// vsaki stranici, števci se preračunajo na polno velikost. Drugi zapisi in scale <= 1
+// dajo natančen histogram kot hist_compute_file.
+HIST_API int hist_compute_file_scaled(hist_t *hist, const char *filename, uint32_t scale, histogram_t *H);
+
+HIST_API void hist_destroy(hist_t *hist);
+
+HIST_API hist_backend_t hist_backend(const hist_t *hist);
+HIST_API uint32_t hist_bins(const hist_t *hist);
+HIST_API const char *hist_backend_name(hist_backend_t backend);
+
+// Prebere sliko v zapisu, ki ga prepozna FreeImage, kot BGRA; sprosti se s hist_free_image.
+HIST_API uint8_t *hist_load_image(const char *filename, uint32_t *width, uint32_t *height);
+HIST_API void hist_free_image(uint8_t *image);
+
+HIST_API void hist_print(const histogram_t *H);
+HIST_API int hist_equal(const histogram_t *A, const histogram_t *B);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif